@@ -1,5 +1,17 @@
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
 #include "bmp.h"
+#include "simd.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 namespace lolita
 {
@@ -37,547 +49,932 @@ typedef struct BGRPalette
 }BGRPalette; 
 
 
-static bool BMP_ReadFileHeader(FILE *bmpfile,BitMapFileHeader& buf) 
+/*
+ * bytes of a bmp file , in a FILE or in memory ,
+ * decoders and encoders work on it , so files and buffers share them
+ */
+class BmpStream
+{
+public:
+    virtual ~BmpStream() = default;
+
+    virtual bool seek(uint64_t offset) = 0;
+    virtual size_t read(void* data, size_t size) = 0;
+    virtual size_t write(const void* data, size_t size) = 0;
+
+    /* size bytes at offset if they are in memory , so that they are not copied by read() */
+    virtual const uint8_t* view(uint64_t offset, size_t size)
+    {
+        (void)offset;
+        (void)size;
+        return NULL;
+    }
+
+    /* total bytes , 0 if it's unknown */
+    virtual uint64_t size()
+    {
+        return 0;
+    }
+
+    /* flush and release , false if it fails */
+    virtual bool close()
+    {
+        return true;
+    }
+};
+
+class FileStream : public BmpStream
+{
+public:
+    explicit FileStream(FILE* fp) : fp_(fp) {}
+    ~FileStream() { close(); }
+
+    /* offsets of huge files don't fit in a long on some systems */
+    bool seek(uint64_t offset)
+    {
+#ifdef _WIN32
+        return _fseeki64(fp_, offset, SEEK_SET) == 0;
+#else
+        return fseeko(fp_, offset, SEEK_SET) == 0;
+#endif
+    }
+
+    size_t read(void* data, size_t size)
+    {
+        return fread(data, 1, size, fp_);
+    }
+
+    size_t write(const void* data, size_t size)
+    {
+        return fwrite(data, 1, size, fp_);
+    }
+
+    uint64_t size()
+    {
+#ifdef _WIN32
+        __int64 length = _filelengthi64(_fileno(fp_));
+        return length >= 0 ? length : 0;
+#else
+        struct stat status;
+        return fstat(fileno(fp_), &status) == 0 ? status.st_size : 0;
+#endif
+    }
+
+    bool close()
+    {
+        bool rval = (fp_ == NULL || fclose(fp_) == 0);
+        fp_ = NULL;
+        return rval;
+    }
+
+private:
+    FILE* fp_;
+};
+
+/* read from a buffer of the caller */
+class MemoryStream : public BmpStream
+{
+public:
+    MemoryStream(const uint8_t* data, size_t size) : data_(data), size_(size), position_(0) {}
+
+    bool seek(uint64_t offset)
+    {
+        position_ = offset;
+        return offset <= size_;
+    }
+
+    size_t read(void* data, size_t size)
+    {
+        size_t rest = position_ < size_ ? size_ - position_ : 0;
+        size = size < rest ? size : rest;
+        if(size > 0)
+        {
+            memcpy(data, data_ + position_, size);
+        }
+        position_ += size;
+        return size;
+    }
+
+    size_t write(const void*, size_t)
+    {
+        return 0;
+    }
+
+    const uint8_t* view(uint64_t offset, size_t size)
+    {
+        return offset <= size_ && size <= size_ - offset ? data_ + offset : NULL;
+    }
+
+    uint64_t size()
+    {
+        return size_;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t position_;
+};
+
+/* write into a vector of the caller , it grows as needed */
+class VectorStream : public BmpStream
+{
+public:
+    explicit VectorStream(std::vector<uint8_t>& data) : data_(data), position_(0) {}
+
+    bool seek(uint64_t offset)
+    {
+        position_ = offset;
+        return true;
+    }
+
+    size_t read(void*, size_t)
+    {
+        return 0;
+    }
+
+    size_t write(const void* data, size_t size)
+    {
+        if(size == 0)
+        {
+            return 0;
+        }
+        if(position_ + size > data_.size())
+        {
+            data_.resize(position_ + size);
+        }
+        memcpy(data_.data() + position_, data, size);
+        position_ += size;
+        return size;
+    }
+
+private:
+    std::vector<uint8_t>& data_;
+    size_t position_;
+};
+
+
+static bool BMP_ReadFileHeader(BmpStream& bmpfile,BitMapFileHeader& buf) 
 { 
 	return
-	fseek(bmpfile,0,SEEK_SET) == 0 &&
-	fread(buf.bfType,2,1,bmpfile) == 1 &&
-	fread(&buf.bfSize,4,1,bmpfile) == 1 &&
-	fread(&buf.bfReserved1,2,1,bmpfile) == 1 &&
-	fread(&buf.bfReserved2,2,1,bmpfile) == 1 &&
-	fread(&buf.bfOffBits,4,1,bmpfile) == 1;
+	bmpfile.seek(0) &&
+	bmpfile.read(buf.bfType,2) == 2 &&
+	bmpfile.read(&buf.bfSize,4) == 4 &&
+	bmpfile.read(&buf.bfReserved1,2) == 2 &&
+	bmpfile.read(&buf.bfReserved2,2) == 2 &&
+	bmpfile.read(&buf.bfOffBits,4) == 4;
 } 
   
-static bool BMP_ReadInfoHeader(FILE *bmpfile,BitMapInfoHeader& buf) 
+static bool BMP_ReadInfoHeader(BmpStream& bmpfile,BitMapInfoHeader& buf) 
 { 
 	return 
-	fseek(bmpfile,14,SEEK_SET) == 0 &&
-	fread(&buf.biSize,4,1,bmpfile) == 1 &&
-	fread(&buf.biWidth,4,1,bmpfile) == 1 &&
-	fread(&buf.biHeight,4,1,bmpfile) == 1 &&
-	fread(&buf.biPlanes,2,1,bmpfile) == 1 &&
-	fread(&buf.biBitCount,2,1,bmpfile) == 1 &&
-	fread(&buf.biCompression,4,1,bmpfile) == 1 &&
-	fread(&buf.biSizeImage,4,1,bmpfile) == 1 &&
-	fread(&buf.biXPelsPerMeter,4,1,bmpfile) == 1 &&
-	fread(&buf.biYPelsPerMeter,4,1,bmpfile) == 1 &&
-	fread(&buf.biClrUsed,4,1,bmpfile) == 1 &&
-	fread(&buf.biClrImportant,4,1,bmpfile) == 1;
+	bmpfile.seek(14) &&
+	bmpfile.read(&buf.biSize,4) == 4 &&
+	bmpfile.read(&buf.biWidth,4) == 4 &&
+	bmpfile.read(&buf.biHeight,4) == 4 &&
+	bmpfile.read(&buf.biPlanes,2) == 2 &&
+	bmpfile.read(&buf.biBitCount,2) == 2 &&
+	bmpfile.read(&buf.biCompression,4) == 4 &&
+	bmpfile.read(&buf.biSizeImage,4) == 4 &&
+	bmpfile.read(&buf.biXPelsPerMeter,4) == 4 &&
+	bmpfile.read(&buf.biYPelsPerMeter,4) == 4 &&
+	bmpfile.read(&buf.biClrUsed,4) == 4 &&
+	bmpfile.read(&buf.biClrImportant,4) == 4;
 } 
   
 
-static bool BMP_WriteFileHeader(FILE *bmpfile,BitMapFileHeader& buf) 
+static bool BMP_WriteFileHeader(BmpStream& bmpfile,BitMapFileHeader& buf) 
 { 
 	return 
-	fseek(bmpfile,0,SEEK_SET) == 0 &&
-	fwrite(buf.bfType,2,1,bmpfile) == 1 &&
-	fwrite(&buf.bfSize,4,1,bmpfile) == 1 &&
-	fwrite(&buf.bfReserved1,2,1,bmpfile) == 1 &&
-	fwrite(&buf.bfReserved2,2,1,bmpfile) == 1 &&
-	fwrite(&buf.bfOffBits,4,1,bmpfile) == 1;
+	bmpfile.seek(0) &&
+	bmpfile.write(buf.bfType,2) == 2 &&
+	bmpfile.write(&buf.bfSize,4) == 4 &&
+	bmpfile.write(&buf.bfReserved1,2) == 2 &&
+	bmpfile.write(&buf.bfReserved2,2) == 2 &&
+	bmpfile.write(&buf.bfOffBits,4) == 4;
 } 
   
-static bool BMP_WriteInfoHeader(FILE *bmpfile,BitMapInfoHeader& buf) 
+static bool BMP_WriteInfoHeader(BmpStream& bmpfile,BitMapInfoHeader& buf) 
 {
 	return 
-	fseek(bmpfile,14,SEEK_SET) == 0 &&
-	fwrite(&buf.biSize,4,1,bmpfile) == 1 &&
-	fwrite(&buf.biWidth,4,1,bmpfile) == 1 &&
-	fwrite(&buf.biHeight,4,1,bmpfile) == 1 &&
-	fwrite(&buf.biPlanes,2,1,bmpfile) == 1 &&
-	fwrite(&buf.biBitCount,2,1,bmpfile) == 1 &&
-	fwrite(&buf.biCompression,4,1,bmpfile) == 1 &&
-	fwrite(&buf.biSizeImage,4,1,bmpfile) == 1 &&
-	fwrite(&buf.biXPelsPerMeter,4,1,bmpfile) == 1 &&
-	fwrite(&buf.biYPelsPerMeter,4,1,bmpfile) == 1 &&
-	fwrite(&buf.biClrUsed,4,1,bmpfile) == 1 &&
-	fwrite(&buf.biClrImportant,4,1,bmpfile) == 1;
+	bmpfile.seek(14) &&
+	bmpfile.write(&buf.biSize,4) == 4 &&
+	bmpfile.write(&buf.biWidth,4) == 4 &&
+	bmpfile.write(&buf.biHeight,4) == 4 &&
+	bmpfile.write(&buf.biPlanes,2) == 2 &&
+	bmpfile.write(&buf.biBitCount,2) == 2 &&
+	bmpfile.write(&buf.biCompression,4) == 4 &&
+	bmpfile.write(&buf.biSizeImage,4) == 4 &&
+	bmpfile.write(&buf.biXPelsPerMeter,4) == 4 &&
+	bmpfile.write(&buf.biYPelsPerMeter,4) == 4 &&
+	bmpfile.write(&buf.biClrUsed,4) == 4 &&
+	bmpfile.write(&buf.biClrImportant,4) == 4;
 }  
 
 
 /**********************************************************************************/
-/* 32bit color BGRA8888 */
-static bool readBgra32(Image& mat, FILE* fp, uint32_t offset, uint32_t w, uint32_t h)
+/* rows of a band are read or written by a single call , in chunks of about this size */
+static const size_t chunkBytes = 1 << 20;
+
+/* values of biCompression */
+static const uint32_t noCompression = 0;
+static const uint32_t rle8Compression = 1;
+static const uint32_t rle4Compression = 2;
+static const uint32_t bitFieldsCompression = 3;
+
+/* position of a row which has no RLE data */
+static const size_t blankRow = static_cast<size_t>(-1);
+
+/* the largest scale of Bmp::read */
+static const uint32_t maxScale = 4096;
+
+/* bytes of line should be multiple of 4 , otherwise filled by 0 */
+static size_t bytesOfPixels(uint32_t w, uint16_t bits)
 {
-    mat.resize(w,h);
-    if(fseek(fp, offset, SEEK_SET) != 0)
+    return (static_cast<size_t>(w) * bits + 7)/8;
+}
+
+static size_t bytesOfLine(uint32_t w, uint16_t bits)
+{
+    return (bytesOfPixels(w, bits) + 3)/4 * 4;
+}
+
+/*
+ * true if bit fields are the layout of Rgba32Pixel , alpha may be unused ;
+ * masks of red , green and blue follow the first 40 bytes of info header , also inside larger headers ,
+ * the alpha mask is there only in headers of 56 bytes or more
+ */
+static bool bgraFields(BmpStream& stream, const BitMapInfoHeader& info)
+{
+    uint32_t masks[4] = {0, 0, 0, 0};
+    size_t bytes = info.biSize >= 56 ? 16 : 12;
+    if(!stream.seek(14 + 40) || stream.read(masks, bytes) != bytes)
     {
         return false;
     }
-    for(uint32_t i = 0; i < h; i++)
-    {
-        for(uint32_t j = 0; j < w; j++) 
-        {
-            mat[h-i-1][j].blue = fgetc(fp);
-            mat[h-i-1][j].green = fgetc(fp);
-            mat[h-i-1][j].red = fgetc(fp);
-            mat[h-i-1][j].alpha = fgetc(fp);
-        }
-    }
 
-    return true;
+    return masks[0] == 0x00ff0000 && masks[1] == 0x0000ff00 && masks[2] == 0x000000ff &&
+            (masks[3] == 0xff000000 || masks[3] == 0);
 }
 
-/* 24bit color BGR888 */
-static bool readBgr24(Image& mat, FILE* fp, uint32_t offset, uint32_t w, uint32_t h)
+/* palette follows the info header , colors out of it are black */
+static bool readColors(BmpStream& stream, const BitMapInfoHeader& info, RgbPixel* palette)
 {
-    mat.resize(w,h);
-    if(fseek(fp, offset, SEEK_SET) != 0)
+    uint32_t count = 1u << info.biBitCount;
+    if(info.biClrUsed != 0 && info.biClrUsed < count)
     {
-        return false;
+        count = info.biClrUsed;
     }
-    for(uint32_t i = 0; i < h; i++)
+
+    BGRPalette colors[256];
+    if(!stream.seek(14 + info.biSize) || stream.read(colors, 4 * count) != 4 * count)
     {
-        for(uint32_t j = 0; j < w; j++) 
-        {
-            mat[h-i-1][j].blue = fgetc(fp);
-            mat[h-i-1][j].green = fgetc(fp);
-            mat[h-i-1][j].red = fgetc(fp);
-        }
+        return false;
+    }
 
-        /* byets of line should be multiple of 4 , otherwise filled by 0 */
-        /* skip these data */
-        size_t skip = (w * 3 + 3)/4 * 4 - w * 3;
-        if(fseek(fp, skip, SEEK_CUR) != 0)
-        {
-            return false;
-        }
+    for(uint32_t i = 0; i < 256; i++)
+    {
+        palette[i].red = i < count ? colors[i].red : 0;
+        palette[i].green = i < count ? colors[i].green : 0;
+        palette[i].blue = i < count ? colors[i].blue : 0;
+        palette[i].alpha = 0;
     }
 
     return true;
 }
 
-/* 16bit color RGB565 */
-static bool readRgb16(Image& mat, FILE* fp, uint32_t offset, uint32_t w, uint32_t h)
+/*
+ * a byte of palette indexes holds 8/bits pixels ,
+ * pixels of all 256 values of a byte are looked up once into a table ,
+ * then every byte of a scanline is expanded by a single copy
+ */
+static void makeTable(const RgbPixel* palette, uint16_t bits, std::vector<RgbPixel>& table)
 {
-    mat.resize(w,h);
-    uint16_t color = 0;
-    if(fseek(fp, offset, SEEK_SET) != 0)
-    {
-        return false;
-    }
-    for(uint32_t i = 0; i < h; i++)
+    uint32_t perByte = 8 / bits;
+    uint32_t mask = (1u << bits) - 1;
+    table.resize(256 * perByte);
+    for(uint32_t value = 0; value < 256; value++)
     {
-        for(uint32_t j = 0; j < w; j++) 
+        /* the first pixel is in the highest bits */
+        for(uint32_t k = 0; k < perByte; k++)
         {
-            if(fread(&color, 2, 1, fp) != 1)
-            {
-            	return false;
-            }
-            mat[h-i-1][j].red  = ((color & 0xf800) >> 11) << 3;
-            mat[h-i-1][j].green = ((color & 0x07e0) >> 5) << 2;
-            mat[h-i-1][j].blue   =  (color & 0x001f) << 3;
-        }
-
-        /* byets of line should be multiple of 4 , otherwise filled by 0 */
-        /* skip these data */
-        size_t skip = (w * 2 + 3)/4 * 4 - w * 2;
-        if(fseek(fp, skip, SEEK_CUR) != 0)
-        {
-        	return false;
+            table[value * perByte + k] = palette[(value >> (8 - bits * (k + 1))) & mask];
         }
     }
+}
 
-    return true;
+template<uint32_t bits>
+static void expandIndexed(const uint8_t* line, RgbPixel* row, uint32_t w, const RgbPixel* table)
+{
+    const uint32_t perByte = 8 / bits;
+    uint32_t full = w / perByte;
+    uint32_t rest = w % perByte;
+    for(uint32_t j = 0; j < full; j++)
+    {
+        memcpy(row + j * perByte, table + line[j] * perByte, sizeof(RgbPixel) * perByte);
+    }
+    if(rest > 0)
+    {
+        memcpy(row + full * perByte, table + line[full] * perByte, sizeof(RgbPixel) * rest);
+    }
 }
 
-/* 8bit color , 256 palettes */
-static bool readPalette8(Image& mat, FILE* fp, uint32_t offset, uint32_t w, uint32_t h)
+/* expand a scanline into a row , direct colors by SIMD kernels , palette indexes by the table */
+static void expandLine(const uint8_t* line, RgbPixel* row, uint32_t w, uint16_t bits, const RgbPixel* table)
 {
-    mat.resize(w,h);
-    uint8_t index = 0;
-    BGRPalette color;
-    for(uint32_t i = 0; i < h; i++)
+    switch(bits)
     {
-        for(uint32_t j = 0; j < w; j++) 
-        {
-            if(fseek(fp, offset + i * w + j, SEEK_SET) != 0)
-            {
-            	return false;
-            }
-            index = fgetc(fp);
-            if(fseek(fp, 14 + 40 + 4 * index, SEEK_SET) != 0 ||
-                fread(&color, 4, 1, fp) != 1)
-            {
-                return false;
-            }
-            mat[h-i-1][j].red = color.red;
-            mat[h-i-1][j].green = color.green;
-            mat[h-i-1][j].blue = color.blue;
-        }
+    case 32:
+        expandBgra32(line, row, w);
+        break;
 
-        /* byets of line should be multiple of 4 , otherwise filled by 0 */
-        /* skip these data */
-        size_t skip = (w + 3)/4 * 4 - w;
-        if(fseek(fp, skip, SEEK_CUR) != 0)
-        {
-            return false;
-        }
-    }
+    case 24:
+        expandBgr24(line, row, w);
+        break;
 
-    return true;
+    case 16:
+        expandRgb565(line, row, w);
+        break;
+
+    case 8:
+        expandIndexed<8>(line, row, w, table);
+        break;
+
+    case 4:
+        expandIndexed<4>(line, row, w, table);
+        break;
+
+    case 1:
+        expandIndexed<1>(line, row, w, table);
+        break;
+    }
 }
 
-/* 4bit color , 16 palettes */
-static bool readPalette4(Image& mat, FILE* fp, uint32_t offset, uint32_t w, uint32_t h)
+/*
+ * RLE data is a stream of (count , index) runs and escapes , rows are stored bottom-up.
+ * Find where decoding of every row starts , so that rows can be decoded in any order ;
+ * a delta escape moves into the middle of a later row , rows skipped by it are blank.
+ */
+static void scanRle(const std::vector<uint8_t>& data, uint32_t h, uint16_t bits,
+                    std::vector<size_t>& positions, std::vector<uint32_t>& columns)
 {
-    uint64_t bytesOfLine = ((w+1)/2 + 3)/4 * 4; // skip filled 0
-    mat.resize(w,h);
-    uint8_t index = 0;
-    BGRPalette color;
-    for(uint32_t i = 0; i < h; i++)
+    positions.assign(h, blankRow);
+    columns.assign(h, 0);
+    if(h == 0)
+    {
+        return;
+    }
+
+    positions[0] = 0;
+    uint32_t y = 0;
+    uint32_t x = 0;
+    size_t pos = 0;
+    while(pos + 1 < data.size())
     {
-        uint32_t j = 0;
-        for(; j < w; j+=2) 
+        uint8_t count = data[pos];
+        uint8_t value = data[pos + 1];
+        pos += 2;
+        if(count > 0)
         {
-            if(fseek(fp, offset + i * bytesOfLine + j/4, SEEK_SET) != 0)
+            x += count;
+        }
+        else if(value == 0) // end of line
+        {
+            if(++y >= h)
             {
-                return false;
+                return;
             }
-            index = fgetc(fp);
-            if(fseek(fp, 14 + 40 + 4 * ((index & 0xf0) >> 4), SEEK_SET) != 0 ||
-                fread(&color, 4, 1, fp) != 1)
+            positions[y] = pos;
+            x = 0;
+        }
+        else if(value == 1) // end of bitmap
+        {
+            return;
+        }
+        else if(value == 2) // delta
+        {
+            if(pos + 1 >= data.size())
             {
-                return false;
+                return;
             }
-            mat[h-i-1][j].red = color.red;
-            mat[h-i-1][j].green = color.green;
-            mat[h-i-1][j].blue = color.blue;
-
-            if(j+1 < w)
+            x += data[pos];
+            uint32_t dy = data[pos + 1];
+            pos += 2;
+            if(dy > 0)
             {
-                if(fseek(fp, 14 + 40 + 4 * (index & 0x0f), SEEK_SET) != 0 ||
-                    fread(&color, 4, 1, fp) != 1)
+                y += dy;
+                if(y >= h)
                 {
-                    return false;
+                    return;
                 }
-                mat[h-i-1][j+1].red = color.red;
-                mat[h-i-1][j+1].green = color.green;
-                mat[h-i-1][j+1].blue = color.blue;
+                positions[y] = pos;
+                columns[y] = x;
             }
         }
+        else // absolute run , padded to 16 bits
+        {
+            size_t bytes = bits == 8 ? value : (value + 1)/2;
+            pos += (bytes + 1) & ~static_cast<size_t>(1);
+            x += value;
+        }
     }
-
-    return true;
 }
 
-/* 1bit color , 2 palettes */
-static bool readPalette1(Image& mat, FILE* fp, uint32_t offset, uint32_t w, uint32_t h)
+/* decode a row of RLE data from where it starts , into a byte per pixel , pixels not coded are index 0 */
+static void decodeRle(const std::vector<uint8_t>& data, size_t pos, uint32_t x, uint16_t bits, uint8_t* line, uint32_t w)
 {
-    uint64_t bytesOfLine = ((w+7)/8 + 3)/4 * 4;
-    mat.resize(w,h);
-    uint8_t index = 0;
-    BGRPalette color;
-    for(uint32_t i = 0; i < h; i++)
+    memset(line, 0, w);
+    if(pos == blankRow)
+    {
+        return;
+    }
+
+    while(pos + 1 < data.size())
     {
-        uint32_t j = 0;
-        for(; j < w; j+=8) 
+        uint8_t count = data[pos];
+        uint8_t value = data[pos + 1];
+        pos += 2;
+        if(count > 0)
         {
-            if(fseek(fp, offset + i * bytesOfLine + j/8, SEEK_SET) != 0)
+            /* 4bit runs alternate the high and the low nibble */
+            uint32_t end = x + count < w ? x + count : w;
+            if(bits == 8)
             {
-                return false;
+                memset(line + (x < end ? x : end), value, x < end ? end - x : 0);
             }
-            index = fgetc(fp);
-
-            for(uint8_t k = 0; k < 8; k++)
+            else
             {
-                /* width isn't multiple of 8 */
-                if(j+k >= w)
-                {
-                    break;
-                }
-
-                if(fseek(fp, 14 + 40 + 4 * ((index >> (7-k)) & 0x01), SEEK_SET) != 0 ||
-                    fread(&color, 4, 1, fp) != 1)
+                for(uint32_t k = x; k < end; k++)
                 {
-                    return false;
+                    line[k] = ((k - x) & 1) ? (value & 0x0f) : (value >> 4);
                 }
-                mat[h-i-1][j+k].red = color.red;
-                mat[h-i-1][j+k].green = color.green;
-                mat[h-i-1][j+k].blue = color.blue;
-                
             }
+            x += count;
+        }
+        else if(value == 0 || value == 1) // end of line or bitmap
+        {
+            return;
+        }
+        else if(value == 2) // delta , it leaves this row if it moves down
+        {
+            if(pos + 1 >= data.size() || data[pos + 1] > 0)
+            {
+                return;
+            }
+            x += data[pos];
+            pos += 2;
+        }
+        else // absolute run
+        {
+            size_t bytes = bits == 8 ? value : (value + 1)/2;
+            if(pos + bytes > data.size())
+            {
+                return;
+            }
+            for(uint32_t k = 0; k < value && x + k < w; k++)
+            {
+                const uint8_t* p = &data[pos];
+                line[x + k] = bits == 8 ? p[k] : ((k & 1) ? (p[k/2] & 0x0f) : (p[k/2] >> 4));
+            }
+            x += value;
+            pos += (bytes + 1) & ~static_cast<size_t>(1);
         }
     }
-
-    return true;
 }
 
-
-/* 32bit color , BGRA8888 */
-static bool writeBgra32(Image& mat, FILE* fp)
+/* length of the run of p[0] , at most n , compared 8 bytes at a time */
+static uint32_t runLength(const uint8_t* p, uint32_t n)
 {
-
-    uint32_t w = mat.width();
-    uint32_t h = mat.height(); 
-
-    BitMapFileHeader fileHeader;
-    BitMapInfoHeader infoHeader;
-
-    fileHeader.bfType[0] = 'B'; 
-    fileHeader.bfType[1] = 'M'; 
-    fileHeader.bfReserved1 = 0; 
-    fileHeader.bfReserved2 = 0; 
-    fileHeader.bfOffBits = 14 + 124;
-    fileHeader.bfSize = 4*w*h + fileHeader.bfOffBits;
-    infoHeader.biSize = 124;
-    infoHeader.biWidth =  w;
-    infoHeader.biHeight = h;
-    infoHeader.biPlanes = 1; 
-    infoHeader.biBitCount = 32;
-    infoHeader.biCompression = 3; 
-    infoHeader.biSizeImage = ((w*4+3)/4*4)*h;
-    infoHeader.biXPelsPerMeter = 2835; 
-    infoHeader.biYPelsPerMeter = 2835; 
-    infoHeader.biClrUsed = 0; 
-    infoHeader.biClrImportant = 0;
-
-    if(!BMP_WriteFileHeader(fp, fileHeader) || !BMP_WriteInfoHeader(fp, infoHeader))
+    uint32_t k = 1;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t pattern = p[0] * 0x0101010101010101ull;
+    for(; k + 8 <= n; k += 8)
     {
-        return false;
+        uint64_t bytes;
+        memcpy(&bytes, p + k, 8);
+        if(bytes != pattern)
+        {
+            return k + (__builtin_ctzll(bytes ^ pattern) >> 3);
+        }
     }
-
-    /* fathomless rule , let them happy */
-    for(int i = 14 + 40; i < 14 + 124; i++)
+#endif
+    while(k < n && p[k] == p[0])
     {
-        fputc(0, fp);
+        k++;
     }
+    return k;
+}
 
-    /* write color data */
-    for(uint32_t i = 0; i < h; i++)
+/*
+ * encode a row of indexes by RLE8 , runs of 2 or more pixels are encoded runs ,
+ * pixels between runs of 3 or more are absolute runs , or runs of 1 if they are less than 3
+ */
+static void encodeRle8(const uint8_t* line, uint32_t w, std::vector<uint8_t>& out)
+{
+    uint32_t i = 0;
+    while(i < w)
     {
-        /* color data of a line */
-        for(uint32_t j = 0; j < w; j++) 
+        uint32_t limit = w - i < 255 ? w - i : 255;
+        uint32_t run = runLength(line + i, limit);
+        if(run >= 2)
         {
-            if(EOF == fputc(mat[h - i - 1][j].blue , fp)   ||
-                EOF == fputc(mat[h - i - 1][j].green , fp) ||
-                EOF == fputc(mat[h - i - 1][j].red , fp)   ||
-                EOF == fputc(mat[h - i - 1][j].alpha , fp) )
-            {
-                return false;
-            }
+            out.push_back(run);
+            out.push_back(line[i]);
+            i += run;
+            continue;
         }
 
-        /* byets of line should be multiple of 4 , otherwise filled by 0 */
-        size_t skip = (w * 4 + 3)/4 * 4 - w * 4;
-        while(skip--)
+        uint32_t j = i;
+        while(j < i + limit)
         {
-            if(EOF == fputc(0,fp))
+            uint32_t r = runLength(line + j, i + limit - j);
+            if(r >= 3)
             {
-                return false;
+                break;
             }
+            j += r;
         }
-    }
-
-    return true;
-}
-
-
-/* 24bit color , BGR888 */
-static bool writeBgr24(Image& mat, FILE* fp)
-{
-
-    uint32_t w = mat.width();
-    uint32_t h = mat.height(); 
-
-    BitMapFileHeader fileHeader;
-    BitMapInfoHeader infoHeader;
-
-    fileHeader.bfType[0] = 'B'; 
-    fileHeader.bfType[1] = 'M'; 
-    fileHeader.bfReserved1 = 0; 
-    fileHeader.bfReserved2 = 0; 
-    fileHeader.bfOffBits = 14 + 40;
-    fileHeader.bfSize = 3*w*h + fileHeader.bfOffBits;
-    infoHeader.biSize = 40;
-    infoHeader.biWidth =  w;
-    infoHeader.biHeight = h;
-    infoHeader.biPlanes = 1; 
-    infoHeader.biBitCount = 24;
-    infoHeader.biCompression = 0; 
-    infoHeader.biSizeImage = ((w*3+3)/4*4)*h;
-    infoHeader.biXPelsPerMeter = 3780; 
-    infoHeader.biYPelsPerMeter = 3780; 
-    infoHeader.biClrUsed = 0; 
-    infoHeader.biClrImportant = 0;
-    
-
-
-    if(!BMP_WriteFileHeader(fp, fileHeader) || !BMP_WriteInfoHeader(fp, infoHeader))
-    {
-        return false;
-    }
 
-    /* write color data */
-    for(uint32_t i = 0; i < h; i++)
-    {
-        /* color data of a line */
-        for(uint32_t j = 0; j < w; j++) 
+        uint32_t n = j - i;
+        if(n < 3)
         {
-            if(EOF == fputc(mat[h - i - 1][j].blue , fp) ||
-                EOF == fputc(mat[h - i - 1][j].green , fp) ||
-                EOF == fputc(mat[h - i - 1][j].red , fp) )
+            for(uint32_t k = i; k < j; k++)
             {
-                return false;
+                out.push_back(1);
+                out.push_back(line[k]);
             }
         }
-
-        /* byets of line should be multiple of 4 , otherwise filled by 0 */
-        size_t skip = (w * 3 + 3)/4 * 4 - w * 3;
-        while(skip--)
+        else
         {
-            if(EOF == fputc(0,fp))
+            out.push_back(0);
+            out.push_back(n);
+            out.insert(out.end(), line + i, line + j);
+            if(n & 1)
             {
-                return false;
+                out.push_back(0);
             }
         }
+        i = j;
     }
+}
 
-    return true;
+/* RLE8 rows are kept from top to bottom , ends[r] is end of row r , write them bottom-up and patch sizes */
+static bool writeRle(BmpStream& stream, uint32_t offset, const std::vector<uint8_t>& data, const std::vector<size_t>& ends)
+{
+    for(size_t r = ends.size(); r > 0; r--)
+    {
+        size_t begin = r > 1 ? ends[r - 2] : 0;
+        size_t length = ends[r - 1] - begin;
+        if(stream.write(data.data() + begin, length) != length)
+        {
+            return false;
+        }
+    }
+
+    const uint8_t end[2] = {0, 1};
+    uint32_t sizeImage = data.size() + 2;
+    uint32_t size = offset + sizeImage;
+    return stream.write(end, 2) == 2 &&
+        stream.seek(2) && stream.write(&size, 4) == 4 &&
+        stream.seek(14 + 20) && stream.write(&sizeImage, 4) == 4;
 }
 
 
-/* 16bit color , BGR565 */
-static bool writeRgb16(Image& mat, FILE* fp)
+/* headers , bit fields or palette , before pixel data at offset ; sizes of RLE8 are patched by writeRle */
+static bool writeHeaders(BmpStream& stream, uint32_t w, uint32_t h, uint16_t bits, bool compress, uint32_t& offset)
 {
-    uint32_t w = mat.width();
-    uint32_t h = mat.height(); 
-
     BitMapFileHeader fileHeader;
     BitMapInfoHeader infoHeader;
 
-    fileHeader.bfType[0] = 'B'; 
-    fileHeader.bfType[1] = 'M'; 
-    fileHeader.bfReserved1 = 0; 
-    fileHeader.bfReserved2 = 0; 
-    fileHeader.bfOffBits = 14 + 40 + 12;
-    fileHeader.bfSize = 2*w*h + fileHeader.bfOffBits;
-    infoHeader.biSize = 40;
-    infoHeader.biWidth =  w;
+    /* 32bit color uses BITMAPV5HEADER for alpha mask , others use BITMAPINFOHEADER */
+    uint32_t extra = 0;
+    switch(bits)
+    {
+    case 32:
+        extra = 124 - 40;
+        break;
+    case 16:
+        extra = 3 * 4;
+        break;
+    case 8:
+        extra = 256 * 4;
+        break;
+    case 1:
+        extra = 2 * 4;
+        break;
+    }
+
+    fileHeader.bfType[0] = 'B';
+    fileHeader.bfType[1] = 'M';
+    fileHeader.bfReserved1 = 0;
+    fileHeader.bfReserved2 = 0;
+    fileHeader.bfOffBits = 14 + 40 + extra;
+    fileHeader.bfSize = (compress ? 0 : bytesOfLine(w, bits) * h) + fileHeader.bfOffBits;
+    infoHeader.biSize = bits == 32 ? 124 : 40;
+    infoHeader.biWidth = w;
     infoHeader.biHeight = h;
-    infoHeader.biPlanes = 1; 
-    infoHeader.biBitCount = 16;
-    infoHeader.biCompression = 3; 
-    infoHeader.biSizeImage = ((w*2+3)/4*4)*h;
-    infoHeader.biXPelsPerMeter = 3780; 
-    infoHeader.biYPelsPerMeter = 3780; 
-    infoHeader.biClrUsed = 0; 
+    infoHeader.biPlanes = 1;
+    infoHeader.biBitCount = bits;
+    infoHeader.biCompression = (bits == 32 || bits == 16) ? bitFieldsCompression :
+                                compress ? rle8Compression : noCompression;
+    infoHeader.biSizeImage = compress ? 0 : bytesOfLine(w, bits) * h;
+    infoHeader.biXPelsPerMeter = 3780;
+    infoHeader.biYPelsPerMeter = 3780;
+    infoHeader.biClrUsed = 0;
     infoHeader.biClrImportant = 0;
-    
-
 
-    if(!BMP_WriteFileHeader(fp, fileHeader) || !BMP_WriteInfoHeader(fp, infoHeader))
+    if(!BMP_WriteFileHeader(stream, fileHeader) || !BMP_WriteInfoHeader(stream, infoHeader))
     {
         return false;
     }
 
-    uint32_t redMass   = 0xf800;
-    uint32_t greenMass = 0x07e0;
-    uint32_t blueMass  = 0x001f; 
-    if(fwrite(&redMass, 4, 1, fp) != 1 || fwrite(&greenMass, 4, 1, fp) != 1 || fwrite(&blueMass, 4, 1, fp) !=1 )
+    std::vector<uint8_t> data(extra, 0);
+    if(bits == 32 || bits == 16)
     {
-        return false;
+        /* red , green , blue and alpha masks */
+        uint32_t masks32[4] = {0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000};
+        uint32_t masks16[3] = {0xf800, 0x07e0, 0x001f};
+        memcpy(data.data(), bits == 32 ? masks32 : masks16, bits == 32 ? sizeof(masks32) : sizeof(masks16));
     }
-
-    for(uint32_t i = 0; i < h; i++)
+    else if(bits == 8 || bits == 1)
     {
-        for(uint32_t j = 0; j < w; j++) 
-        {
-            uint16_t color = 
-            (((uint16_t)((mat[h - i - 1][j].red)   & 0xf8) ) << 8) |
-            (((uint16_t)((mat[h - i - 1][j].green) & 0xfc) ) << 3) |
-            (((uint16_t)((mat[h - i - 1][j].blue)  & 0xf8) ) >> 3) ;
-            if(fwrite(&color, 2, 1, fp) != 1)
-            {
-                return false;
-            }
-        }
-
-        /* byets of line should be multiple of 4 , otherwise filled by 0 */
-        size_t skip = (w * 2 + 3)/4 * 4 - w * 2;
-        while(skip--)
+        /* gray palette , or black and white */
+        uint32_t count = 1u << bits;
+        for(uint32_t i = 0; i < count; i++)
         {
-            if(EOF == fputc(0,fp))
-            {
-                return false;
-            }
+            uint8_t gray = static_cast<uint8_t>(i * 255 / (count - 1));
+            data[4*i] = data[4*i+1] = data[4*i+2] = gray;
         }
     }
 
-    return true;
+    offset = fileHeader.bfOffBits;
+    return extra == 0 || stream.write(data.data(), extra) == extra;
 }
 
-
-/* 8bit color , only for gray scale image */
-static bool writeGray8(Image& mat, FILE* fp)
+/* encode a row into a scanline , padding is left as it is , fail if 8bit isn't gray or 1bit isn't binary */
+static bool packLine(const RgbPixel* row, uint8_t* line, uint32_t w, uint16_t bits)
 {
-    uint32_t w = mat.width();
-    uint32_t h = mat.height(); 
+    switch(bits)
+    {
+    case 32:
+        packBgra32(row, line, w);
+        return true;
+
+    case 24:
+        packBgr24(row, line, w);
+        return true;
+
+    case 16:
+        for(uint32_t j = 0; j < w; j++, line += 2)
+        {
+            uint16_t color = 
+            (((uint16_t)((row[j].red)   & 0xf8) ) << 8) |
+            (((uint16_t)((row[j].green) & 0xfc) ) << 3) |
+            (((uint16_t)((row[j].blue)  & 0xf8) ) >> 3) ;
+            line[0] = color & 0xff;
+            line[1] = color >> 8;
+        }
+        return true;
+
+    case 8:
+        for(uint32_t j = 0; j < w; j++)
+        {
+            /* Not gray scale image */
+            if(row[j].blue != row[j].green || row[j].blue != row[j].red)
+            {
+                return false;
+            }
+            line[j] = row[j].blue;
+        }
+        return true;
 
+    case 1:
+        for(uint32_t j = 0; j < w; j += 8)
+        {
+            uint8_t color = 0;
+            uint32_t end = j + 8 < w ? j + 8 : w;
+            for(uint32_t k = j; k < end; k++)
+            {
+                if(row[k].red == 0 && row[k].green == 0 && row[k].blue == 0)
+                {
+                    continue;
+                }
+                else if(row[k].red == 0xff && row[k].green == 0xff && row[k].blue == 0xff)
+                {
+                    color |= 0x80 >> (k - j);
+                }
+                else // not binary image
+                {
+                    return false;
+                }
+            }
+            line[j/8] = color;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * headers of a file which can be decoded ,
+ * negative height means rows are stored from top to bottom , RLE data can't be
+ */
+static bool readHeaders(BmpStream& stream, BitMapFileHeader& fileHeader, BitMapInfoHeader& infoHeader)
+{
+    if(!BMP_ReadFileHeader(stream, fileHeader) || !BMP_ReadInfoHeader(stream, infoHeader) ||
+        fileHeader.bfType[0] != 'B' || fileHeader.bfType[1] != 'M')
+    {
+        return false;
+    }
+
+    uint16_t bits = infoHeader.biBitCount;
+    uint32_t compression = infoHeader.biCompression;
+    bool topDown = static_cast<int32_t>(infoHeader.biHeight) < 0;
+    return (bits == 32 || bits == 24 || bits == 16 || bits == 8 || bits == 4 || bits == 1) &&
+        (compression == noCompression ||
+            (compression == bitFieldsCompression && (bits == 32 || bits == 16)) ||
+            (compression == rle8Compression && bits == 8 && !topDown) ||
+            (compression == rle4Compression && bits == 4 && !topDown));
+}
+
+static bool probeStream(BmpStream& stream, BmpInfo& info)
+{
     BitMapFileHeader fileHeader;
     BitMapInfoHeader infoHeader;
+    if(!readHeaders(stream, fileHeader, infoHeader))
+    {
+        return false;
+    }
 
-    fileHeader.bfType[0] = 'B'; 
-    fileHeader.bfType[1] = 'M'; 
-    fileHeader.bfReserved1 = 0; 
-    fileHeader.bfReserved2 = 0; 
-    fileHeader.bfOffBits = 14 + 40 + 256 * 4;
-    fileHeader.bfSize = w*h + fileHeader.bfOffBits;
-    infoHeader.biSize = 40;
-    infoHeader.biWidth =  w;
-    infoHeader.biHeight = h;
-    infoHeader.biPlanes = 1; 
-    infoHeader.biBitCount = 8;
-    infoHeader.biCompression = 0; 
-    infoHeader.biSizeImage = ((w+3)/4*4)*h;
-    infoHeader.biXPelsPerMeter = 3780; 
-    infoHeader.biYPelsPerMeter = 3780; 
-    infoHeader.biClrUsed = 0; 
-    infoHeader.biClrImportant = 0;
+    int32_t height = static_cast<int32_t>(infoHeader.biHeight);
+    info.width = infoHeader.biWidth;
+    info.height = height < 0 ? -static_cast<int64_t>(height) : height;
+    info.bits = infoHeader.biBitCount;
+    info.compression = infoHeader.biCompression;
+    info.topDown = height < 0;
+
+    /*
+     * rows of Image are aligned as Mat does , RLE data is kept while decoding ,
+     * but not more than the rest of the stream , biSizeImage is not trusted
+     */
+    uint64_t step = (sizeof(RgbPixel) * static_cast<uint64_t>(info.width) + Image::alignment - 1)
+                    / Image::alignment * Image::alignment;
+    info.memory = step * info.height;
+    if(info.compression == rle8Compression || info.compression == rle4Compression)
+    {
+        uint64_t size = stream.size();
+        uint64_t rest = size > fileHeader.bfOffBits ? size - fileHeader.bfOffBits : 0;
+        uint64_t data = infoHeader.biSizeImage > 0 ? infoHeader.biSizeImage : rest;
+        info.memory += std::min(data, rest);
+    }
+
+    return true;
+}
 
-    if(!BMP_WriteFileHeader(fp, fileHeader) || !BMP_WriteInfoHeader(fp, infoHeader))
+/* the smallest scale which makes w x h fit into maxWidth x maxHeight , 0 if the box is empty */
+static uint32_t fitScale(uint32_t w, uint32_t h, uint32_t maxWidth, uint32_t maxHeight)
+{
+    if(maxWidth == 0 || maxHeight == 0)
     {
-        return false;
+        return 0;
     }
 
-    /* write 256 pallete */
-    BGRPalette color;
-    for(uint16_t gray = 0; gray < 256; gray++)
+    uint32_t sx = w / maxWidth + (w % maxWidth > 0);
+    uint32_t sy = h / maxHeight + (h % maxHeight > 0);
+    uint32_t scale = sx > sy ? sx : sy;
+    return scale > 0 ? scale : 1;
+}
+
+/* x / n , m is 2^32 / n , q is x / n or 1 less before the fix */
+static inline uint32_t divide(uint32_t x, uint32_t n, uint64_t m)
+{
+    uint32_t q = static_cast<uint32_t>((x * m) >> 32);
+    return q + ((q + 1) * n <= x);
+}
+
+/* sum channels of scale columns , starting from n / 2 for rounding */
+template<uint32_t fixed>
+static inline void sumColumns(const uint32_t* columns, uint32_t scale, uint32_t n, uint32_t* sum)
+{
+    scale = fixed > 0 ? fixed : scale;
+    sum[0] = sum[1] = sum[2] = sum[3] = n / 2;
+    for(uint32_t i = 0; i < scale; i++)
     {
-        color.blue = color.green = color.red = (uint8_t)gray;
-        if(fwrite(&color, 4, 1, fp) != 1)
+        for(uint32_t c = 0; c < 4; c++)
         {
-            return false;
+            sum[c] += columns[4 * i + c];
         }
     }
+}
 
+/* average every scale columns into a pixel , columns are channels summed over k rows , a fixed scale is unrolled */
+template<uint32_t fixed>
+static void averageColumns(const uint32_t* columns, RgbPixel* out, uint32_t blocks, uint32_t scale, uint32_t k)
+{
+    scale = fixed > 0 ? fixed : scale;
+    uint32_t n = scale * k;
+    uint32_t sum[4];
 
-    /* write color data */
-    for(uint32_t i = 0; i < h; i++)
+    /* whole blocks of 1/2 , 1/4 and 1/8 are divided by shift , a division in the loop costs twice the time */
+    if((n & (n - 1)) == 0)
     {
-        /* color data of a line */
-        for(uint32_t j = 0; j < w; j++) 
+        uint32_t shift = __builtin_ctz(n);
+        for(uint32_t ox = 0; ox < blocks; ox++, columns += 4 * scale)
         {
-            /* Not gray scale image */
-            if(mat[h - i - 1][j].blue != mat[h - i - 1][j].green || 
-                mat[h - i - 1][j].blue != mat[h - i - 1][j].red)
+            sumColumns<fixed>(columns, scale, n, sum);
+            out[ox].red   = static_cast<int16_t>(sum[0] >> shift);
+            out[ox].green = static_cast<int16_t>(sum[1] >> shift);
+            out[ox].blue  = static_cast<int16_t>(sum[2] >> shift);
+            out[ox].alpha = static_cast<int16_t>(sum[3] >> shift);
+        }
+        return;
+    }
+
+    uint64_t m = (static_cast<uint64_t>(1) << 32) / n;
+    for(uint32_t ox = 0; ox < blocks; ox++, columns += 4 * scale)
+    {
+        sumColumns<fixed>(columns, scale, n, sum);
+        out[ox].red   = static_cast<int16_t>(divide(sum[0], n, m));
+        out[ox].green = static_cast<int16_t>(divide(sum[1], n, m));
+        out[ox].blue  = static_cast<int16_t>(divide(sum[2], n, m));
+        out[ox].alpha = static_cast<int16_t>(divide(sum[3], n, m));
+    }
+}
+
+/*
+ * read all rows and average every scale x scale block , blocks on the right and bottom edge may be smaller ,
+ * only a band of rows is decoded at a time , so full size pixels are never stored
+ */
+static bool readScaled(BmpReader& reader, Image& mat, uint32_t scale)
+{
+    /* sums of 255 in a block must fit in 32 bits */
+    if(scale == 0 || scale > maxScale)
+    {
+        return false;
+    }
+
+    uint32_t w = reader.width();
+    uint32_t h = reader.height();
+    if(scale == 1 || w == 0 || h == 0)
+    {
+        mat.resize(w, h);
+        return reader.readRows(mat, h) == h;
+    }
+
+    uint32_t ow = w / scale + (w % scale > 0);
+    uint32_t oh = h / scale + (h % scale > 0);
+    mat.resize(ow, oh);
+
+    /* about chunkBytes of pixels in a band , and whole blocks */
+    size_t blocks = chunkBytes / (sizeof(RgbPixel) * static_cast<size_t>(w) * scale);
+    uint32_t rows = static_cast<uint32_t>(blocks > 0 ? (blocks < oh ? blocks : oh) : 1) * scale;
+
+    /* channels of a band row are summed column by column first , it's a flat loop of int16_t */
+    Image band;
+    std::vector<uint32_t> columns(4 * static_cast<size_t>(w));
+    for(uint32_t oy = 0; oy < oh; )
+    {
+        uint32_t count = reader.readRows(band, rows);
+        if(count == 0)
+        {
+            return false;
+        }
+
+        for(uint32_t t = 0; t < count; t += scale, oy++)
+        {
+            uint32_t k = count - t < scale ? count - t : scale;
+            std::fill(columns.begin(), columns.end(), 0);
+            for(uint32_t y = t; y < t + k; y++)
             {
-                return false;
+                const int16_t* channels = &band[y][0].red;
+                for(size_t i = 0; i < columns.size(); i++)
+                {
+                    columns[i] += static_cast<uint16_t>(channels[i]);
+                }
             }
 
-            if(EOF == fputc(mat[h - i - 1][j].blue, fp))
+            /* blocks on the right edge are narrower */
+            RgbPixel* out = &mat[oy][0];
+            uint32_t whole = w / scale;
+            switch(scale)
             {
-                return false;
+            case 2:
+                averageColumns<2>(columns.data(), out, whole, scale, k);
+                break;
+            case 4:
+                averageColumns<4>(columns.data(), out, whole, scale, k);
+                break;
+            case 8:
+                averageColumns<8>(columns.data(), out, whole, scale, k);
+                break;
+            default:
+                averageColumns<0>(columns.data(), out, whole, scale, k);
+                break;
             }
-        }
-
-        /* byets of line should be multiple of 4 , otherwise filled by 0 */
-        size_t skip = (w+3)/4 * 4 - w;
-        while(skip--)
-        {
-            if(EOF == fputc(0,fp))
+            if(whole < ow)
             {
-                return false;
+                averageColumns<0>(&columns[4 * whole * scale], out + whole, 1, w % scale, k);
             }
         }
     }
@@ -585,189 +982,620 @@ static bool writeGray8(Image& mat, FILE* fp)
     return true;
 }
 
+/*******************************************************************/
+
+bool Bmp::read(Image& mat, std::string file)
+{
+    return read(mat, file, 1);
+}
+
+bool Bmp::read(Image& mat, std::string file, uint32_t scale)
+{
+    BmpReader reader;
+    return reader.open(file) && readScaled(reader, mat, scale);
+}
+
+bool Bmp::read(Image& mat, std::string file, uint32_t maxWidth, uint32_t maxHeight)
+{
+    BmpReader reader;
+    return reader.open(file) &&
+            readScaled(reader, mat, fitScale(reader.width(), reader.height(), maxWidth, maxHeight));
+}
+
+bool Bmp::write(const Image& mat, std::string file, uint8_t bits, bool compress)
+{
+    BmpWriter writer;
+    if(!writer.open(file, mat.width(), mat.height(), bits, compress))
+    {
+        return false;
+    }
+
+    bool rval = writer.writeRows(mat);
+    return writer.close() && rval;
+}
+
+bool Bmp::decode(const uint8_t* data, size_t size, Image& mat)
+{
+    return decode(data, size, mat, 1);
+}
+
+bool Bmp::decode(const uint8_t* data, size_t size, Image& mat, uint32_t scale)
+{
+    BmpReader reader;
+    return reader.open(data, size) && readScaled(reader, mat, scale);
+}
+
+bool Bmp::decode(const uint8_t* data, size_t size, Image& mat, uint32_t maxWidth, uint32_t maxHeight)
+{
+    BmpReader reader;
+    return reader.open(data, size) &&
+            readScaled(reader, mat, fitScale(reader.width(), reader.height(), maxWidth, maxHeight));
+}
+
+bool Bmp::encode(const Image& mat, std::vector<uint8_t>& data, uint8_t bits, bool compress)
+{
+    BmpWriter writer;
+    if(!writer.open(data, mat.width(), mat.height(), bits, compress))
+    {
+        return false;
+    }
+
+    bool rval = writer.writeRows(mat);
+    return writer.close() && rval;
+}
+
+bool Bmp::probe(std::string file, BmpInfo& info)
+{
+    FILE* fp = fopen(file.c_str(),"rb");
+    if(fp == NULL)
+    {
+        return false;
+    }
+
+    FileStream stream(fp);
+    return probeStream(stream, info);
+}
+
+bool Bmp::probe(const uint8_t* data, size_t size, BmpInfo& info)
+{
+    MemoryStream stream(data, size);
+    return probeStream(stream, info);
+}
 
-/* 1bit color , only for binary image */
-static bool writeBinary1(Image& mat, FILE* fp)
+BmpMapping Bmp::map(std::string file)
 {
-    uint32_t w = mat.width();
-    uint32_t h = mat.height(); 
+    BmpMapping mapping;
+    FILE* fp = fopen(file.c_str(),"rb");
+    if(fp == NULL)
+    {
+        return mapping;
+    }
+
+#ifdef _WIN32
+    void* data = NULL;
+    size_t size = 0;
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(fp)));
+    LARGE_INTEGER length;
+    if(GetFileSizeEx(handle, &length))
+    {
+        size = length.QuadPart;
+        HANDLE section = CreateFileMapping(handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if(section != NULL)
+        {
+            data = MapViewOfFile(section, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(section);
+        }
+    }
+#else
+    void* data = NULL;
+    size_t size = 0;
+    struct stat status;
+    if(fstat(fileno(fp), &status) == 0 && status.st_size > 0)
+    {
+        size = status.st_size;
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(fp), 0);
+        data = (data == MAP_FAILED ? NULL : data);
+    }
+#endif
+    fclose(fp);
+
+    if(data == NULL)
+    {
+        return mapping;
+    }
+    mapping.data_ = data;
+    mapping.size_ = size;
 
+    /* only layouts of compact pixels , 32bit may use bit fields of BGRA , other fields are left to read */
+    MemoryStream stream(static_cast<const uint8_t*>(data), size);
     BitMapFileHeader fileHeader;
     BitMapInfoHeader infoHeader;
+    if(!BMP_ReadFileHeader(stream, fileHeader) || !BMP_ReadInfoHeader(stream, infoHeader) ||
+        fileHeader.bfType[0] != 'B' || fileHeader.bfType[1] != 'M' ||
+        (infoHeader.biBitCount != 32 && infoHeader.biBitCount != 24 && infoHeader.biBitCount != 8) ||
+        (infoHeader.biCompression != noCompression &&
+            !(infoHeader.biCompression == bitFieldsCompression && infoHeader.biBitCount == 32 &&
+                bgraFields(stream, infoHeader))))
+    {
+        mapping.unmap();
+        return mapping;
+    }
 
-    fileHeader.bfType[0] = 'B'; 
-    fileHeader.bfType[1] = 'M'; 
-    fileHeader.bfReserved1 = 0; 
-    fileHeader.bfReserved2 = 0; 
-    fileHeader.bfOffBits = 14 + 40 + 2 * 4;
-    fileHeader.bfSize = (w*h+7)/8 + fileHeader.bfOffBits;
-    infoHeader.biSize = 40;
-    infoHeader.biWidth =  w;
-    infoHeader.biHeight = h;
-    infoHeader.biPlanes = 1; 
-    infoHeader.biBitCount = 1;
-    infoHeader.biCompression = 0; 
-    infoHeader.biSizeImage = ((w+3)/4*4)*h;
-    infoHeader.biXPelsPerMeter = 3780; 
-    infoHeader.biYPelsPerMeter = 3780; 
-    infoHeader.biClrUsed = 0; 
-    infoHeader.biClrImportant = 0;
+    int32_t height = static_cast<int32_t>(infoHeader.biHeight);
+    uint32_t w = infoHeader.biWidth;
+    uint32_t h = height < 0 ? -static_cast<int64_t>(height) : height;
+    uint16_t bits = infoHeader.biBitCount;
+    size_t line = bytesOfLine(w, bits);
 
-    if(!BMP_WriteFileHeader(fp, fileHeader) || !BMP_WriteInfoHeader(fp, infoHeader))
+    /* padding of the last line may be missing at the end of file */
+    if(h > 0 && static_cast<uint64_t>(fileHeader.bfOffBits) + line * (h - 1) + bytesOfPixels(w, bits) > size)
     {
-        return false;
+        mapping.unmap();
+        return mapping;
     }
 
-    /* write 2 pallete */
-    BGRPalette color;
-    color.blue = color.green = color.red = 0;
-    if(fwrite(&color, 4, 1, fp) != 1)
+    uint8_t* pixels = static_cast<uint8_t*>(data) + fileHeader.bfOffBits;
+    mapping.top_ = (height < 0 || h == 0) ? pixels : pixels + line * (h - 1);
+    mapping.step_ = height < 0 ? line : -static_cast<ptrdiff_t>(line);
+    mapping.width_ = w;
+    mapping.height_ = h;
+    mapping.bits_ = bits;
+    return mapping;
+}
+
+/*******************************************************************/
+
+BmpReader::BmpReader():
+    width_(0),
+    height_(0),
+    bits_(0),
+    compression_(0),
+    offset_(0),
+    topDown_(false),
+    row_(0)
+{
+
+}
+
+BmpReader::~BmpReader()
+{
+    close();
+}
+
+bool BmpReader::open(std::string file)
+{
+    close();
+    FILE* fp = fopen(file.c_str(),"rb");
+    if(fp == NULL)
     {
         return false;
     }
-    color.blue = color.green = color.red = 0xff;
-    if(fwrite(&color, 4, 1, fp) != 1)
+
+    stream_.reset(new FileStream(fp));
+    return parse();
+}
+
+bool BmpReader::open(const uint8_t* data, size_t size)
+{
+    close();
+    stream_.reset(new MemoryStream(data, size));
+    return parse();
+}
+
+void BmpReader::close()
+{
+    stream_.reset();
+    rle_.clear();
+}
+
+uint32_t BmpReader::width() const
+{
+    return width_;
+}
+
+uint32_t BmpReader::height() const
+{
+    return height_;
+}
+
+uint16_t BmpReader::bits() const
+{
+    return bits_;
+}
+
+uint32_t BmpReader::row() const
+{
+    return row_;
+}
+
+/* headers and palette of stream_ */
+bool BmpReader::parse()
+{
+    BitMapFileHeader fileHeader;
+    BitMapInfoHeader infoHeader;
+    RgbPixel palette[256];
+    if(!readHeaders(*stream_, fileHeader, infoHeader) ||
+        (infoHeader.biBitCount <= 8 && !readColors(*stream_, infoHeader, palette)))
     {
+        close();
         return false;
     }
-    
 
+    int32_t height = static_cast<int32_t>(infoHeader.biHeight);
+    width_ = infoHeader.biWidth;
+    height_ = height < 0 ? -static_cast<int64_t>(height) : height;
+    bits_ = infoHeader.biBitCount;
+    compression_ = infoHeader.biCompression;
+    offset_ = fileHeader.bfOffBits;
+    topDown_ = height < 0;
+    row_ = 0;
+
+    /* RLE data is small , it's kept in memory and rows are decoded into a byte per pixel */
+    if(compression_ == rle8Compression || compression_ == rle4Compression)
+    {
+        if(!readRle(infoHeader.biSizeImage))
+        {
+            close();
+            return false;
+        }
+        scanRle(rle_, height_, bits_, rlePositions_, rleColumns_);
+        makeTable(palette, 8, table_);
+    }
+    else if(bits_ <= 8)
+    {
+        makeTable(palette, bits_, table_);
+    }
+
+    return true;
+}
 
-    /* write color data */
-    for(uint32_t i = 0; i < h; i++)
+uint32_t BmpReader::readRows(Image& band, uint32_t n)
+{
+    uint32_t count = height_ - row_ < n ? height_ - row_ : n;
+    if(!stream_ || count == 0)
+    {
+        return 0;
+    }
+
+    band.resize(width_, count);
+    if(compression_ == rle8Compression || compression_ == rle4Compression)
     {
-        /* color data of a line */
-        for(uint32_t j = 0; j < w; j+=8) 
+        indexes_.resize(width_);
+        for(uint32_t t = 0; t < count; t++)
         {
-            uint8_t color = 0;
-            for(int bit = 0; bit < 8; bit++)
-            {
-                /* width isn't multiple of 8 */
-                if(j+bit >= w)
-                {
-                    break;
-                }
+            uint32_t y = height_ - 1 - (row_ + t);
+            decodeRle(rle_, rlePositions_[y], rleColumns_[y], bits_, indexes_.data(), width_);
+            expandIndexed<8>(indexes_.data(), &band[t][0], width_, table_.data());
+        }
+        row_ += count;
+        return count;
+    }
 
-                if(mat[h-i-1][j+bit].red == 0    && 
-                    mat[h-i-1][j+bit].green == 0 && 
-                    mat[h-i-1][j+bit].blue == 0)
-                {
-                    continue;
-                }
-                else if(mat[h-i-1][j+bit].red == 0xff && 
-                    mat[h-i-1][j+bit].green == 0xff   && 
-                    mat[h-i-1][j+bit].blue == 0xff)
-                {
-                    color |= 1 << (7-bit);
-                }
-                else // not binary image
-                {
-                    return false;
-                }
-            }
-            
-            if(EOF == fputc(color, fp))
+    size_t line = bytesOfLine(width_, bits_);
+    size_t pixels = bytesOfPixels(width_, bits_);
+    size_t chunk = chunkBytes / line > 0 ? chunkBytes / line : 1;
+    for(uint32_t done = 0; done < count; )
+    {
+        /* rows of a chunk are adjacent in the file , in reversed order if bottom-up */
+        uint32_t k = count - done < chunk ? count - done : chunk;
+        uint32_t top = row_ + done;
+        uint64_t first = topDown_ ? top : height_ - top - k;
+
+        /* padding of the last line may be missing at the end of file */
+        /* scanlines in memory are expanded in place , others are read into buffer_ */
+        size_t need = k * line - (line - pixels);
+        const uint8_t* lines = stream_->view(offset_ + first * line, need);
+        if(lines == NULL)
+        {
+            buffer_.resize(k * line);
+            if(!stream_->seek(offset_ + first * line) || stream_->read(buffer_.data(), k * line) < need)
             {
-                return false;
+                return 0;
             }
+            lines = buffer_.data();
         }
 
-        /* byets of line should be multiple of 4 , otherwise filled by 0 */
-        size_t skip = ((w+7)/8 + 3)/4 * 4 - (w+7)/8;
-        while(skip--)
+        for(uint32_t t = 0; t < k; t++)
         {
-            if(EOF == fputc(0,fp))
-            {
-                return false;
-            }
+            const uint8_t* src = lines + (topDown_ ? t : k - 1 - t) * line;
+            expandLine(src, &band[done + t][0], width_, bits_, table_.data());
+        }
+        done += k;
+    }
+
+    row_ += count;
+    return count;
+}
+
+/*
+ * read all RLE data , size is biSizeImage , or till the end of file if it's 0 ;
+ * biSizeImage is not trusted , the buffer grows by chunks as data is really read ,
+ * so a wrong size never allocates more than the file has
+ */
+bool BmpReader::readRle(uint32_t size)
+{
+    if(!stream_->seek(offset_))
+    {
+        return false;
+    }
+
+    size_t length = 0;
+    size_t limit = size > 0 ? size : SIZE_MAX;
+    while(length < limit)
+    {
+        size_t chunk = std::min(chunkBytes, limit - length);
+        rle_.resize(length + chunk);
+        size_t n = stream_->read(rle_.data() + length, chunk);
+        length += n;
+        if(n < chunk)
+        {
+            break;
         }
     }
 
+    rle_.resize(length);
     return true;
 }
 
 /*******************************************************************/
 
-bool Bmp::read(Image& mat, std::string file)
+BmpWriter::BmpWriter():
+    width_(0),
+    height_(0),
+    bits_(0),
+    compress_(false),
+    offset_(0),
+    row_(0)
 {
-    FILE* fp = fopen(file.c_str(),"rb");
+
+}
+
+BmpWriter::~BmpWriter()
+{
+    close();
+}
+
+bool BmpWriter::open(std::string file, uint32_t width, uint32_t height, uint8_t bits, bool compress)
+{
+    close();
+    if((bits != 32 && bits != 24 && bits != 16 && bits != 8 && bits != 1) || (compress && bits != 8))
+    {
+        return false;
+    }
+
+    FILE* fp = fopen(file.c_str(),"wb");
     if(fp == NULL)
     {
         return false;
     }
 
-    BitMapFileHeader fileHeader;
-    BitMapInfoHeader infoHeader;
+    stream_.reset(new FileStream(fp));
+    return start(width, height, bits, compress);
+}
 
-    if(!BMP_ReadFileHeader(fp, fileHeader) || !BMP_ReadInfoHeader(fp, infoHeader))
+bool BmpWriter::open(std::vector<uint8_t>& data, uint32_t width, uint32_t height, uint8_t bits, bool compress)
+{
+    close();
+    if((bits != 32 && bits != 24 && bits != 16 && bits != 8 && bits != 1) || (compress && bits != 8))
     {
         return false;
     }
 
-    mat.resize(infoHeader.biWidth, infoHeader.biHeight);
+    data.clear();
+    if(!compress)
+    {
+        data.reserve(14 + 124 + 256 * 4 + bytesOfLine(width, bits) * height);
+    }
+    stream_.reset(new VectorStream(data));
+    return start(width, height, bits, compress);
+}
 
-    bool rval = false;
-    switch(infoHeader.biBitCount)
+bool BmpWriter::close()
+{
+    if(!stream_)
     {
-    case 32:
-        rval = readBgra32(mat, fp, fileHeader.bfOffBits, infoHeader.biWidth, infoHeader.biHeight);
-        break;
+        return false;
+    }
 
-    case 24:
-        rval = readBgr24(mat, fp, fileHeader.bfOffBits, infoHeader.biWidth, infoHeader.biHeight);
-        break;
+    bool complete = (row_ == height_);
+    if(compress_ && complete)
+    {
+        complete = writeRle(*stream_, offset_, rle_, rleEnds_);
+    }
+    complete = stream_->close() && complete;
+    stream_.reset();
+    rle_.clear();
+    rleEnds_.clear();
+    return complete;
+}
 
-    case 16:
-        rval = readRgb16(mat, fp, fileHeader.bfOffBits, infoHeader.biWidth, infoHeader.biHeight);
-        break;
-    
-    case 8:
-        rval = readPalette8(mat, fp, fileHeader.bfOffBits, infoHeader.biWidth, infoHeader.biHeight);
-        break;
+uint32_t BmpWriter::row() const
+{
+    return row_;
+}
 
-    case 4:
-        rval = readPalette4(mat, fp, fileHeader.bfOffBits, infoHeader.biWidth, infoHeader.biHeight);
-        break;
+bool BmpWriter::writeRows(const Image& band)
+{
+    uint32_t count = band.height();
+    if(!stream_ || band.width() != width_ || count > height_ - row_)
+    {
+        return false;
+    }
 
-    case 1:
-        rval = readPalette1(mat, fp, fileHeader.bfOffBits, infoHeader.biWidth, infoHeader.biHeight);
-        break;
+    /* compressed rows are kept until all rows are written , then written bottom-up */
+    if(compress_)
+    {
+        buffer_.resize(width_);
+        for(uint32_t t = 0; t < count; t++)
+        {
+            if(!packLine(&band[t][0], buffer_.data(), width_, bits_))
+            {
+                return false;
+            }
+            encodeRle8(buffer_.data(), width_, rle_);
+            rle_.push_back(0);  // end of line
+            rle_.push_back(0);
+            rleEnds_.push_back(rle_.size());
+        }
+        row_ += count;
+        return true;
     }
-    fclose(fp);
-    return rval;
+
+    size_t line = bytesOfLine(width_, bits_);
+    size_t chunk = chunkBytes / line > 0 ? chunkBytes / line : 1;
+    for(uint32_t done = 0; done < count; )
+    {
+        /* rows are stored from bottom to top , so a chunk is encoded in reversed order */
+        uint32_t k = count - done < chunk ? count - done : chunk;
+        uint64_t first = height_ - (row_ + done) - k;
+        buffer_.assign(k * line, 0);
+        for(uint32_t t = 0; t < k; t++)
+        {
+            if(!packLine(&band[done + t][0], buffer_.data() + (k - 1 - t) * line, width_, bits_))
+            {
+                return false;
+            }
+        }
+
+        if(!stream_->seek(offset_ + first * line) || stream_->write(buffer_.data(), k * line) != k * line)
+        {
+            return false;
+        }
+        done += k;
+    }
+
+    row_ += count;
+    return true;
 }
 
-bool Bmp::write(Image& mat, std::string file, uint8_t bits)
+/* headers into stream_ */
+bool BmpWriter::start(uint32_t width, uint32_t height, uint8_t bits, bool compress)
 {
-    FILE* fp = fopen(file.c_str(),"wb");
-    if(fp == NULL)
+    width_ = width;
+    height_ = height;
+    bits_ = bits;
+    compress_ = compress;
+    row_ = 0;
+    rle_.clear();
+    rleEnds_.clear();
+    if(!writeHeaders(*stream_, width, height, bits, compress, offset_))
     {
+        close();
         return false;
     }
 
-    bool rval = false;
-    switch(bits)
+    return true;
+}
+
+/*******************************************************************/
+
+BmpMapping::BmpMapping():
+    data_(NULL),
+    size_(0),
+    top_(NULL),
+    step_(0),
+    width_(0),
+    height_(0),
+    bits_(0)
+{
+
+}
+
+BmpMapping::~BmpMapping()
+{
+    unmap();
+}
+
+BmpMapping::BmpMapping(BmpMapping&& other):
+    BmpMapping()
+{
+    *this = std::move(other);
+}
+
+BmpMapping& BmpMapping::operator=(BmpMapping&& other)
+{
+    if(this != &other)
     {
-    case 32 :
-        rval = writeBgra32(mat, fp);
-        break;
-    case 24 :
-        rval = writeBgr24(mat, fp);
-        break;
-    case 16 : 
-        rval = writeRgb16(mat, fp);
-        break;
-    case 8:
-        rval = writeGray8(mat, fp);
-        break;
-    case 1:
-        rval = writeBinary1(mat, fp);
-        break;
+        unmap();
+        data_ = other.data_;
+        size_ = other.size_;
+        top_ = other.top_;
+        step_ = other.step_;
+        width_ = other.width_;
+        height_ = other.height_;
+        bits_ = other.bits_;
+        other.data_ = NULL;
+        other.unmap();
     }
 
-    fclose(fp);
-    return rval;
+    return *this;
+}
+
+bool BmpMapping::isMapped() const
+{
+    return data_ != NULL;
+}
+
+void BmpMapping::unmap()
+{
+    if(data_ != NULL)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+#else
+        munmap(data_, size_);
+#endif
+    }
+
+    data_ = NULL;
+    size_ = 0;
+    top_ = NULL;
+    step_ = 0;
+    width_ = 0;
+    height_ = 0;
+    bits_ = 0;
 }
 
+uint32_t BmpMapping::width() const
+{
+    return width_;
+}
+
+uint32_t BmpMapping::height() const
+{
+    return height_;
+}
+
+uint16_t BmpMapping::bits() const
+{
+    return bits_;
+}
+
+Rgba32Image BmpMapping::bgra32() const
+{
+    if(data_ == NULL || bits_ != 32)
+    {
+        return Rgba32Image();
+    }
+    return Rgba32Image(width_, height_, reinterpret_cast<Rgba32Pixel*>(top_), step_);
+}
+
+Rgb24Image BmpMapping::bgr24() const
+{
+    if(data_ == NULL || bits_ != 24)
+    {
+        return Rgb24Image();
+    }
+    return Rgb24Image(width_, height_, reinterpret_cast<Rgb24Pixel*>(top_), step_);
+}
+
+GrayImage BmpMapping::indexes() const
+{
+    if(data_ == NULL || bits_ != 8)
+    {
+        return GrayImage();
+    }
+    return GrayImage(width_, height_, top_, step_);
+}
 
 }; // namespace lolita
@@ -2,23 +2,203 @@
 #define LOLITA_BMP_H
 
 #include <stdint.h>
+#include <memory>
 #include <string>
+#include <vector>
 #include "mat.hpp"
 
 namespace lolita
 {
 
+class BmpMapping;
+class BmpStream;
+
+/* what Bmp::probe finds in headers */
+struct BmpInfo
+{
+    uint32_t width;
+    uint32_t height;
+    uint16_t bits;
+    uint32_t compression;       // 0 none , 1 RLE8 , 2 RLE4 , 3 bit fields
+    bool topDown;               // rows are stored from top to bottom
+    uint64_t memory;            // bytes needed by Bmp::read to decode it
+};
+
 class Bmp
 {
 public:
     static std::string error();
     static bool read(Image& mat, std::string file);
-    static bool write(Image& mat, std::string file, uint8_t bits=24);
+    static bool write(const Image& mat, std::string file, uint8_t bits=24, bool compress=false);
+
+    /* read 1/scale of the size , every scale x scale block is averaged while rows are decoded */
+    static bool read(Image& mat, std::string file, uint32_t scale);
+
+    /* read with the smallest scale that fits into maxWidth x maxHeight */
+    static bool read(Image& mat, std::string file, uint32_t maxWidth, uint32_t maxHeight);
+
+    /* the same as read and write , but on bytes of a bmp file in memory */
+    static bool decode(const uint8_t* data, size_t size, Image& mat);
+    static bool decode(const uint8_t* data, size_t size, Image& mat, uint32_t scale);
+    static bool decode(const uint8_t* data, size_t size, Image& mat, uint32_t maxWidth, uint32_t maxHeight);
+    static bool encode(const Image& mat, std::vector<uint8_t>& data, uint8_t bits=24, bool compress=false);
+
+    /* parse headers only , fail if the file can't be decoded */
+    static bool probe(std::string file, BmpInfo& info);
+    static bool probe(const uint8_t* data, size_t size, BmpInfo& info);
+
+    /* map an uncompressed 32 , 24 or 8 bits file into memory , pixels are not decoded ; 32 bits bit fields must be BGRA */
+    static BmpMapping map(std::string file);
 
 private:
     static std::string errorMessage;
 };
 
+/*
+ * Read a bmp file band by band , rows are always read from top to bottom ,
+ * only one band is in memory at a time.
+ *
+ *     BmpReader reader;
+ *     Image band;
+ *     if(reader.open("huge.bmp"))
+ *     {
+ *         while(reader.readRows(band, 256) > 0)
+ *         {
+ *             // rows [reader.row() - band.height(), reader.row()) of the image
+ *         }
+ *     }
+ */
+class BmpReader
+{
+public:
+    BmpReader();
+    ~BmpReader();
+    BmpReader(const BmpReader&) = delete;
+    BmpReader& operator=(const BmpReader&) = delete;
+
+    bool open(std::string file);
+    bool open(const uint8_t* data, size_t size);     // data is used till close()
+    void close();
+
+    uint32_t width() const;
+    uint32_t height() const;
+    uint16_t bits() const;
+
+    /* count of rows read */
+    uint32_t row() const;
+
+    /* read at most n next rows into band , resized to width x rows , return count of rows , 0 at the end or on error */
+    uint32_t readRows(Image& band, uint32_t n);
+
+private:
+    bool parse();
+    bool readRle(uint32_t size);
+
+    std::unique_ptr<BmpStream> stream_;
+    uint32_t width_;
+    uint32_t height_;
+    uint16_t bits_;
+    uint32_t compression_;
+    uint32_t offset_;               // offset of pixel data
+    bool topDown_;                  // negative height in the header
+    uint32_t row_;
+    std::vector<RgbPixel> table_;   // pixels of every byte of palette indexes
+    std::vector<uint8_t> buffer_;   // scanlines read by a single fread
+
+    std::vector<uint8_t> rle_;              // all RLE data
+    std::vector<size_t> rlePositions_;      // where every row starts in RLE data , bottom-up
+    std::vector<uint32_t> rleColumns_;      // column where a row starts , it's not 0 after a delta
+    std::vector<uint8_t> indexes_;          // a row decoded from RLE data
+};
+
+/*
+ * Write a bmp file band by band , rows are written from top to bottom ,
+ * the file is complete after all height rows are written and closed.
+ *
+ *     BmpWriter writer;
+ *     writer.open("huge.bmp", width, height, 24);
+ *     writer.writeRows(band);      // again and again
+ *     writer.close();
+ */
+class BmpWriter
+{
+public:
+    BmpWriter();
+    ~BmpWriter();
+    BmpWriter(const BmpWriter&) = delete;
+    BmpWriter& operator=(const BmpWriter&) = delete;
+
+    /* bits and compress are the same as Bmp::write */
+    bool open(std::string file, uint32_t width, uint32_t height, uint8_t bits=24, bool compress=false);
+    bool open(std::vector<uint8_t>& data, uint32_t width, uint32_t height, uint8_t bits=24, bool compress=false);
+
+    /* false if not all rows are written or flushing fails */
+    bool close();
+
+    /* count of rows written */
+    uint32_t row() const;
+
+    /* append rows of band , its width must be the width of the file */
+    bool writeRows(const Image& band);
+
+private:
+    bool start(uint32_t width, uint32_t height, uint8_t bits, bool compress);
+
+    std::unique_ptr<BmpStream> stream_;
+    uint32_t width_;
+    uint32_t height_;
+    uint16_t bits_;
+    bool compress_;
+    uint32_t offset_;               // offset of pixel data
+    uint32_t row_;
+    std::vector<uint8_t> buffer_;   // scanlines written by a single fwrite
+
+    std::vector<uint8_t> rle_;      // RLE8 rows from top to bottom , written bottom-up by close()
+    std::vector<size_t> rleEnds_;   // end of every row in rle_
+};
+
+/*
+ * A bmp file mapped into memory by Bmp::map , pixels are viewed in place , without decoding.
+ * Views are valid while the mapping is alive , pages are copied on write ,
+ * so writing through a view never changes the file.
+ *
+ *     BmpMapping mapping = Bmp::map("photo.bmp");
+ *     Rgba32Image pixels = mapping.bgra32();
+ */
+class BmpMapping
+{
+public:
+    BmpMapping();
+    ~BmpMapping();
+    BmpMapping(BmpMapping&& other);
+    BmpMapping& operator=(BmpMapping&& other);
+    BmpMapping(const BmpMapping&) = delete;
+    BmpMapping& operator=(const BmpMapping&) = delete;
+
+    bool isMapped() const;
+    void unmap();
+
+    uint32_t width() const;
+    uint32_t height() const;
+    uint16_t bits() const;
+
+    /* views of pixels , rows from top to bottom , empty if bits of the file are different */
+    Rgba32Image bgra32() const;
+    Rgb24Image bgr24() const;
+    GrayImage indexes() const;      // palette indexes of 8 bits , they are gray values in files of Bmp::write
+
+private:
+    friend class Bmp;
+
+    void* data_;                    // the whole file
+    size_t size_;
+    uint8_t* top_;                  // first pixel of the top row
+    ptrdiff_t step_;                // negative if rows are stored bottom-up
+    uint32_t width_;
+    uint32_t height_;
+    uint16_t bits_;
+};
+
 }; // namespace lolita
 
 #endif
\ No newline at end of file
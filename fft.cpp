@@ -0,0 +1,555 @@
+#include "fft.h"
+#include "parallel.h"
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace lolita
+{
+
+/**[Private]***********************************************************************************************/
+/* everything needed to transform a size , it's never changed after made , so threads share it */
+template<typename T>
+struct Plan
+{
+    uint32_t n;
+    uint32_t radix;                         // the largest factor , scratch needed by the generic butterfly
+    std::vector<uint32_t> factors;          // pairs of radix p and m , n of the stage is p * m
+    std::vector<std::complex<T>> twiddles;  // exp(-2 pi i k / n)
+};
+
+/* a real transform of even n is a complex transform of n / 2 , and a pass which splits even and odd parts */
+template<typename T>
+struct RealPlan
+{
+    uint32_t n;
+    std::shared_ptr<const Plan<T>> plan;    // plan of n / 2 if n is even , otherwise n
+    std::vector<std::complex<T>> twiddles;  // exp(-2 pi i k / n) , k <= n / 2
+};
+
+template<typename T>
+static std::shared_ptr<const Plan<T>> complexPlan(uint32_t n);
+template<typename T>
+static std::shared_ptr<const RealPlan<T>> realPlan(uint32_t n);
+template<typename T>
+static void transform(const Plan<T>& plan, const std::complex<T>* in, size_t stride, std::complex<T>* out, std::complex<T>* scratch);
+template<typename T>
+static void work(const Plan<T>& plan, const uint32_t* factors, std::complex<T>* out, const std::complex<T>* in, size_t stride, size_t fstride, std::complex<T>* scratch);
+template<typename T>
+static void realForward(const RealPlan<T>& real, const T* in, std::complex<T>* out, std::complex<T>* buffer, std::complex<T>* scratch);
+template<typename T>
+static void realInverse(const RealPlan<T>& real, const std::complex<T>* in, T* out, std::complex<T>* buffer, std::complex<T>* scratch);
+template<typename T>
+static void transformColumns(Mat<std::complex<T>>& mat, bool inverse);
+template<typename T>
+static void forward2d(const Mat<T>& src, Mat<std::complex<T>>& dst);
+template<typename T>
+static bool inverse2d(const Mat<std::complex<T>>& src, Mat<T>& dst, uint32_t width);
+template<typename T>
+static void complex2d(Mat<std::complex<T>>& mat, bool inverse);
+
+/* rows of a band share buffers , and a band is big enough to be worth a thread */
+static const uint32_t rowGrain = 16;
+
+/* columns transformed together , 8 complex<double> are 2 cache lines of a row */
+static const uint32_t columnGroup = 8;
+
+static const double pi = 3.14159265358979323846;
+
+/* operator * of std::complex checks inf and nan , it's much slower */
+template<typename T>
+static inline std::complex<T> multiply(const std::complex<T>& a, const std::complex<T>& b)
+{
+    return std::complex<T>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+
+/**********************************************************************************************************/
+uint32_t fftSize(uint32_t n)
+{
+    for(uint64_t size = n > 1 ? n : 1; ; size++)
+    {
+        uint64_t rest = size;
+        for(uint32_t p : {2, 3, 5})
+        {
+            while(rest % p == 0)
+            {
+                rest /= p;
+            }
+        }
+
+        if(rest == 1)
+        {
+            return static_cast<uint32_t>(size);
+        }
+    }
+}
+
+void dft(const Mat<double>& src, Mat<std::complex<double>>& dst)
+{
+    forward2d(src, dst);
+}
+
+void dft(const Mat<float>& src, Mat<std::complex<float>>& dst)
+{
+    forward2d(src, dst);
+}
+
+bool idft(const Mat<std::complex<double>>& src, Mat<double>& dst, uint32_t width)
+{
+    return inverse2d(src, dst, width);
+}
+
+bool idft(const Mat<std::complex<float>>& src, Mat<float>& dst, uint32_t width)
+{
+    return inverse2d(src, dst, width);
+}
+
+void fft(Mat<std::complex<double>>& mat, bool inverse)
+{
+    complex2d(mat, inverse);
+}
+
+void fft(Mat<std::complex<float>>& mat, bool inverse)
+{
+    complex2d(mat, inverse);
+}
+
+
+/**[Private]***********************************************************************************************/
+/* plans are made once for every size and type , and kept till exit */
+template<typename T>
+static std::shared_ptr<const Plan<T>> complexPlan(uint32_t n)
+{
+    static std::mutex mutex;
+    static std::map<uint32_t, std::shared_ptr<const Plan<T>>> plans;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const Plan<T>>& cached = plans[n];
+    if(cached)
+    {
+        return cached;
+    }
+
+    std::shared_ptr<Plan<T>> plan(new Plan<T>);
+    plan->n = n;
+    plan->radix = 1;
+
+    /* radix 4 first , then 2 , 3 , 5 and other primes */
+    uint32_t rest = n;
+    uint32_t p = 4;
+    while(rest > 1)
+    {
+        while(rest % p != 0)
+        {
+            p = p == 4 ? 2 : p == 2 ? 3 : p + 2;
+            if(static_cast<uint64_t>(p) * p > rest)
+            {
+                p = rest;
+            }
+        }
+        rest /= p;
+        plan->factors.push_back(p);
+        plan->factors.push_back(rest);
+        plan->radix = p > plan->radix ? p : plan->radix;
+    }
+
+    /* computed in double , so that float twiddles are rounded only once */
+    plan->twiddles.resize(n);
+    for(uint32_t k = 0; k < n; k++)
+    {
+        double phase = -2 * pi * k / n;
+        plan->twiddles[k] = std::complex<T>(static_cast<T>(cos(phase)), static_cast<T>(sin(phase)));
+    }
+
+    cached = plan;
+    return cached;
+}
+
+template<typename T>
+static std::shared_ptr<const RealPlan<T>> realPlan(uint32_t n)
+{
+    static std::mutex mutex;
+    static std::map<uint32_t, std::shared_ptr<const RealPlan<T>>> plans;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const RealPlan<T>>& cached = plans[n];
+    if(cached)
+    {
+        return cached;
+    }
+
+    std::shared_ptr<RealPlan<T>> real(new RealPlan<T>);
+    real->n = n;
+    real->plan = complexPlan<T>(n % 2 == 0 ? n / 2 : n);
+    real->twiddles.resize(n / 2 + 1);
+    for(uint32_t k = 0; k <= n / 2; k++)
+    {
+        double phase = -2 * pi * k / n;
+        real->twiddles[k] = std::complex<T>(static_cast<T>(cos(phase)), static_cast<T>(sin(phase)));
+    }
+
+    cached = real;
+    return cached;
+}
+
+/* forward transform of n elements of in , stride elements apart , into out ; scratch holds plan.radix elements */
+template<typename T>
+static void transform(const Plan<T>& plan, const std::complex<T>* in, size_t stride, std::complex<T>* out, std::complex<T>* scratch)
+{
+    if(plan.n == 1)
+    {
+        out[0] = in[0];
+        return;
+    }
+
+    work(plan, plan.factors.data(), out, in, stride, 1, scratch);
+}
+
+/*
+ * decimation in time , out gets p transforms of m elements which are fstride * p apart in in ,
+ * then butterflies of radix p combine them
+ */
+template<typename T>
+static void work(const Plan<T>& plan, const uint32_t* factors, std::complex<T>* out, const std::complex<T>* in, size_t stride, size_t fstride, std::complex<T>* scratch)
+{
+    const uint32_t p = factors[0];
+    const uint32_t m = factors[1];
+    const std::complex<T>* tw = plan.twiddles.data();
+
+    if(m == 1)
+    {
+        for(uint32_t q = 0; q < p; q++)
+        {
+            out[q] = in[q * fstride * stride];
+        }
+    }
+    else
+    {
+        for(uint32_t q = 0; q < p; q++)
+        {
+            work(plan, factors + 2, out + q * m, in + q * fstride * stride, stride, fstride * p, scratch);
+        }
+    }
+
+    switch(p)
+    {
+    case 2:
+        for(uint32_t k = 0; k < m; k++)
+        {
+            std::complex<T> t = multiply(out[k + m], tw[k * fstride]);
+            out[k + m] = out[k] - t;
+            out[k] += t;
+        }
+        break;
+
+    case 3:
+    {
+        const T half = static_cast<T>(0.5);
+        const T sine = static_cast<T>(0.86602540378443864676);     // sin(pi / 3)
+        for(uint32_t k = 0; k < m; k++)
+        {
+            std::complex<T> b = multiply(out[k + m], tw[k * fstride]);
+            std::complex<T> c = multiply(out[k + 2 * m], tw[2 * k * fstride]);
+            std::complex<T> sum = b + c;
+            std::complex<T> difference = (b - c) * sine;
+            std::complex<T> base = out[k] - sum * half;
+            out[k] += sum;
+            out[k + m]     = std::complex<T>(base.real() + difference.imag(), base.imag() - difference.real());
+            out[k + 2 * m] = std::complex<T>(base.real() - difference.imag(), base.imag() + difference.real());
+        }
+        break;
+    }
+
+    case 4:
+        for(uint32_t k = 0; k < m; k++)
+        {
+            std::complex<T> b = multiply(out[k + m], tw[k * fstride]);
+            std::complex<T> c = multiply(out[k + 2 * m], tw[2 * k * fstride]);
+            std::complex<T> d = multiply(out[k + 3 * m], tw[3 * k * fstride]);
+            std::complex<T> ac = out[k] - c;
+            std::complex<T> bd = b - d;
+            out[k] += c;
+            out[k + 2 * m] = out[k] - (b + d);
+            out[k] += b + d;
+            out[k + m]     = std::complex<T>(ac.real() + bd.imag(), ac.imag() - bd.real());
+            out[k + 3 * m] = std::complex<T>(ac.real() - bd.imag(), ac.imag() + bd.real());
+        }
+        break;
+
+    default:
+    {
+        /* any prime , p * p complex multiplications for p outputs */
+        const uint32_t n = plan.n;
+        for(uint32_t u = 0; u < m; u++)
+        {
+            for(uint32_t q = 0; q < p; q++)
+            {
+                scratch[q] = out[u + q * m];
+            }
+
+            for(uint32_t q = 0; q < p; q++)
+            {
+                uint32_t k = u + q * m;
+                uint32_t index = 0;
+                std::complex<T> sum = scratch[0];
+                for(uint32_t r = 1; r < p; r++)
+                {
+                    index += fstride * k;
+                    index = index >= n ? index - n : index;
+                    sum += multiply(scratch[r], tw[index]);
+                }
+                out[k] = sum;
+            }
+        }
+        break;
+    }
+    }
+}
+
+/* n real elements into n / 2 + 1 complex ; buffer holds n complex elements */
+template<typename T>
+static void realForward(const RealPlan<T>& real, const T* in, std::complex<T>* out, std::complex<T>* buffer, std::complex<T>* scratch)
+{
+    uint32_t n = real.n;
+    if(n % 2 != 0)
+    {
+        std::complex<T>* values = buffer + n;
+        for(uint32_t i = 0; i < n; i++)
+        {
+            values[i] = in[i];
+        }
+        transform(*real.plan, values, 1, buffer, scratch);
+        std::copy(buffer, buffer + n / 2 + 1, out);
+        return;
+    }
+
+    /* even and odd elements are real and imaginary parts of a transform of n / 2 , rows of Mat are aligned */
+    uint32_t h = n / 2;
+    transform(*real.plan, reinterpret_cast<const std::complex<T>*>(in), 1, buffer, scratch);
+    for(uint32_t k = 0; k <= h; k++)
+    {
+        std::complex<T> z = buffer[k < h ? k : 0];
+        std::complex<T> w = std::conj(buffer[k > 0 ? h - k : 0]);
+        std::complex<T> even = (z + w) * static_cast<T>(0.5);
+        std::complex<T> odd = std::complex<T>(z.imag() - w.imag(), w.real() - z.real()) * static_cast<T>(0.5);
+        out[k] = even + multiply(real.twiddles[k], odd);
+    }
+}
+
+/* n / 2 + 1 complex elements into n real , multiplied by n ; buffer holds 2 * n complex elements */
+template<typename T>
+static void realInverse(const RealPlan<T>& real, const std::complex<T>* in, T* out, std::complex<T>* buffer, std::complex<T>* scratch)
+{
+    uint32_t n = real.n;
+    std::complex<T>* values = buffer + n;
+    if(n % 2 != 0)
+    {
+        /* the inverse is conj(F(conj(x))) , only real parts are needed , so the last conj is skipped */
+        for(uint32_t k = 0; k <= n / 2; k++)
+        {
+            values[k] = std::conj(in[k]);
+            if(k > 0)
+            {
+                values[n - k] = in[k];
+            }
+        }
+        transform(*real.plan, values, 1, buffer, scratch);
+        for(uint32_t i = 0; i < n; i++)
+        {
+            out[i] = buffer[i].real();
+        }
+        return;
+    }
+
+    uint32_t h = n / 2;
+    for(uint32_t k = 0; k < h; k++)
+    {
+        std::complex<T> a = in[k];
+        std::complex<T> b = std::conj(in[h - k]);
+        std::complex<T> odd = multiply(a - b, std::conj(real.twiddles[k]));
+        values[k] = std::conj(a + b + std::complex<T>(-odd.imag(), odd.real()));
+    }
+    transform(*real.plan, values, 1, buffer, scratch);
+    for(uint32_t i = 0; i < h; i++)
+    {
+        out[2 * i] = buffer[i].real();
+        out[2 * i + 1] = -buffer[i].imag();
+    }
+}
+
+/*
+ * transform every column in place , the inverse is not divided ;
+ * columns are gathered into a buffer by groups , so that a row is read by whole cache lines
+ */
+template<typename T>
+static void transformColumns(Mat<std::complex<T>>& mat, bool inverse)
+{
+    uint32_t w = mat.width();
+    uint32_t h = mat.height();
+    if(w == 0 || h <= 1)
+    {
+        return;
+    }
+
+    std::shared_ptr<const Plan<T>> plan = complexPlan<T>(h);
+    size_t stride = mat.step() / sizeof(std::complex<T>);
+    std::complex<T>* data = &mat[0][0];
+    uint32_t groups = (w + columnGroup - 1) / columnGroup;
+    parallelFor(0, groups, 1, [&](uint32_t first, uint32_t last)
+    {
+        std::vector<std::complex<T>> columns(columnGroup * static_cast<size_t>(h));
+        std::vector<std::complex<T>> buffer(h);
+        std::vector<std::complex<T>> scratch(plan->radix);
+        for(uint32_t g = first; g < last; g++)
+        {
+            uint32_t x0 = g * columnGroup;
+            uint32_t n = w - x0 < columnGroup ? w - x0 : columnGroup;
+            for(uint32_t y = 0; y < h; y++)
+            {
+                const std::complex<T>* row = data + y * stride + x0;
+                for(uint32_t i = 0; i < n; i++)
+                {
+                    columns[i * h + y] = inverse ? std::conj(row[i]) : row[i];
+                }
+            }
+
+            for(uint32_t i = 0; i < n; i++)
+            {
+                transform(*plan, &columns[i * h], 1, buffer.data(), scratch.data());
+                std::copy(buffer.begin(), buffer.end(), &columns[i * h]);
+            }
+
+            for(uint32_t y = 0; y < h; y++)
+            {
+                std::complex<T>* row = data + y * stride + x0;
+                for(uint32_t i = 0; i < n; i++)
+                {
+                    row[i] = inverse ? std::conj(columns[i * h + y]) : columns[i * h + y];
+                }
+            }
+        }
+    });
+}
+
+template<typename T>
+static void forward2d(const Mat<T>& src, Mat<std::complex<T>>& dst)
+{
+    uint32_t w = src.width();
+    uint32_t h = src.height();
+    if(dst.width() != w / 2 + 1 || dst.height() != h || dst.isShared())
+    {
+        dst = Mat<std::complex<T>>(w / 2 + 1, h);
+    }
+    if(w == 0 || h == 0)
+    {
+        return;
+    }
+
+    std::shared_ptr<const RealPlan<T>> real = realPlan<T>(w);
+    parallelFor(0, h, rowGrain, [&](uint32_t first, uint32_t last)
+    {
+        std::vector<std::complex<T>> buffer(2 * static_cast<size_t>(w));
+        std::vector<std::complex<T>> scratch(real->plan->radix);
+        for(uint32_t y = first; y < last; y++)
+        {
+            realForward(*real, &src[y][0], &dst[y][0], buffer.data(), scratch.data());
+        }
+    });
+
+    transformColumns(dst, false);
+}
+
+template<typename T>
+static bool inverse2d(const Mat<std::complex<T>>& src, Mat<T>& dst, uint32_t width)
+{
+    uint32_t h = src.height();
+    if(src.width() != width / 2 + 1)
+    {
+        return false;
+    }
+
+    if(dst.width() != width || dst.height() != h || dst.isShared())
+    {
+        dst = Mat<T>(width, h);
+    }
+    if(width == 0 || h == 0)
+    {
+        return true;
+    }
+
+    /* columns are transformed on a copy , src is kept */
+    Mat<std::complex<T>> spectrum = src;
+    transformColumns(spectrum, true);
+
+    std::shared_ptr<const RealPlan<T>> real = realPlan<T>(width);
+    T scale = static_cast<T>(1.0 / (static_cast<double>(width) * h));
+    parallelFor(0, h, rowGrain, [&](uint32_t first, uint32_t last)
+    {
+        std::vector<std::complex<T>> buffer(2 * static_cast<size_t>(width));
+        std::vector<std::complex<T>> scratch(real->plan->radix);
+        for(uint32_t y = first; y < last; y++)
+        {
+            T* row = &dst[y][0];
+            realInverse(*real, &spectrum[y][0], row, buffer.data(), scratch.data());
+            for(uint32_t x = 0; x < width; x++)
+            {
+                row[x] *= scale;
+            }
+        }
+    });
+
+    return true;
+}
+
+template<typename T>
+static void complex2d(Mat<std::complex<T>>& mat, bool inverse)
+{
+    uint32_t w = mat.width();
+    uint32_t h = mat.height();
+    if(w == 0 || h == 0)
+    {
+        return;
+    }
+
+    mat.detach();
+    std::shared_ptr<const Plan<T>> plan = complexPlan<T>(w);
+    parallelFor(0, h, rowGrain, [&](uint32_t first, uint32_t last)
+    {
+        std::vector<std::complex<T>> buffer(w);
+        std::vector<std::complex<T>> scratch(plan->radix);
+        for(uint32_t y = first; y < last; y++)
+        {
+            std::complex<T>* row = &mat[y][0];
+            for(uint32_t x = 0; x < w; x++)
+            {
+                buffer[x] = inverse ? std::conj(row[x]) : row[x];
+            }
+            transform(*plan, buffer.data(), 1, row, scratch.data());
+        }
+    });
+
+    transformColumns(mat, false);
+    if(!inverse)
+    {
+        return;
+    }
+
+    /* the inverse is conj(F(conj(x))) / n */
+    T scale = static_cast<T>(1.0 / (static_cast<double>(w) * h));
+    parallelFor(0, h, rowGrain, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t y = first; y < last; y++)
+        {
+            std::complex<T>* row = &mat[y][0];
+            for(uint32_t x = 0; x < w; x++)
+            {
+                row[x] = std::conj(row[x]) * scale;
+            }
+        }
+    });
+}
+
+}; // namespace lolita
@@ -0,0 +1,40 @@
+/* Discrete Fourier transform by mixed-radix FFT */
+#ifndef LOLITA_FFT_H
+#define LOLITA_FFT_H
+
+#include <cstdint>
+#include <complex>
+#include "mat.hpp"
+
+namespace lolita
+{
+
+/*
+ * Any size can be transformed , sizes made of 2 , 3 and 5 are the fastest , see fftSize().
+ * Twiddle factors of every size are computed once and cached , so transforms of the same size
+ * in a loop don't pay for them again.
+ *
+ *     Mat<double> plane(width, height);
+ *     Mat<std::complex<double>> spectrum;
+ *     dft(plane, spectrum);        // width / 2 + 1 columns
+ *     idft(spectrum, plane, width);
+ */
+
+/* the smallest size not less than n which is a product of 2 , 3 and 5 */
+uint32_t fftSize(uint32_t n);
+
+/* 2-D transform of a real matrix , only width / 2 + 1 columns are kept , others are conjugates of them */
+void dft(const Mat<double>& src, Mat<std::complex<double>>& dst);
+void dft(const Mat<float>& src, Mat<std::complex<float>>& dst);
+
+/* inverse of dft , width is the width of the real matrix , the result is divided by width * height */
+bool idft(const Mat<std::complex<double>>& src, Mat<double>& dst, uint32_t width);
+bool idft(const Mat<std::complex<float>>& src, Mat<float>& dst, uint32_t width);
+
+/* 2-D complex transform in place , the inverse is divided by width * height */
+void fft(Mat<std::complex<double>>& mat, bool inverse = false);
+void fft(Mat<std::complex<float>>& mat, bool inverse = false);
+
+}; // namespace lolita
+
+#endif
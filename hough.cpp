@@ -0,0 +1,595 @@
+#include "hough.h"
+#include "tools.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+
+namespace lolita
+{
+
+/**[Private]***********************************************************************************************/
+static const double pi = 3.14159265358979323846;
+
+/* an edge point of a band , in float so that votes are computed by float multiply-add */
+struct Point
+{
+    float x;
+    float y;
+};
+
+/* an edge point of the circle transform , (dx, dy) is the unit gradient */
+struct Edge
+{
+    float x;
+    float y;
+    float dx;
+    float dy;
+};
+
+template<typename Pixel>
+static std::vector<Line> lines(const Mat<Pixel>& edges, double rhoRes, double thetaRes, uint32_t threshold);
+static bool isEdge(const RgbPixel& pixel);
+static bool isEdge(uint8_t pixel);
+static void gradients(const GrayImage& src, std::vector<int16_t>& gx, std::vector<int16_t>& gy, std::vector<int16_t>& magnitudes);
+static void edgePoints(const GrayImage& src, uint32_t edgeThreshold, std::vector<Edge>& edges, std::vector<uint32_t>& rows);
+static bool clip(float position, float direction, float low, float high, float& first, float& last);
+static void radius(const std::vector<Edge>& edges, const std::vector<uint32_t>& rows,
+                    uint32_t minRadius, uint32_t maxRadius, Circle& circle);
+
+
+/**********************************************************************************************************/
+std::vector<Line> houghLines(const Image& edges, double rhoRes, double thetaRes, uint32_t threshold)
+{
+    return lines(edges, rhoRes, thetaRes, threshold);
+}
+
+std::vector<Line> houghLines(const GrayImage& edges, double rhoRes, double thetaRes, uint32_t threshold)
+{
+    return lines(edges, rhoRes, thetaRes, threshold);
+}
+
+std::vector<Circle> houghCircles(const Image& src, uint32_t minRadius, uint32_t maxRadius, uint32_t threshold,
+                                    double minDistance, uint32_t edgeThreshold)
+{
+    GrayImage gray;
+    grayScale(src, gray);
+    return houghCircles(gray, minRadius, maxRadius, threshold, minDistance, edgeThreshold);
+}
+
+/*
+ * the accumulator is split into bands of rows and every band is voted by its own thread ,
+ * a point votes only the part of its gradient line inside the band , so threads never share a counter
+ * and there is nothing to add at the end
+ */
+std::vector<Circle> houghCircles(const GrayImage& src, uint32_t minRadius, uint32_t maxRadius, uint32_t threshold,
+                                    double minDistance, uint32_t edgeThreshold)
+{
+    std::vector<Circle> result;
+    uint32_t w = src.width();
+    uint32_t h = src.height();
+    minRadius = minRadius > 0 ? minRadius : 1;
+
+    /* no circle found in the image is larger than its diagonal , so UINT32_MAX means no upper limit */
+    uint32_t diagonal = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(w) * w + static_cast<double>(h) * h)));
+    maxRadius = maxRadius < diagonal ? maxRadius : diagonal;
+    if(w < 3 || h < 3 || minRadius > maxRadius)
+    {
+        return result;
+    }
+
+    std::vector<Edge> edges;
+    std::vector<uint32_t> rows;
+    edgePoints(src, edgeThreshold, edges, rows);
+
+    std::vector<uint32_t> votes(static_cast<size_t>(w) * h, 0);
+    uint32_t bands = threads() < h ? threads() : h;
+    parallelFor(0, bands, 1, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t b = first; b < last; b++)
+        {
+            uint32_t top = static_cast<uint64_t>(b) * h / bands;
+            uint32_t bottom = static_cast<uint64_t>(b + 1) * h / bands;
+            uint32_t height = bottom - top;
+            uint32_t* band = &votes[static_cast<size_t>(top) * w];
+            for(const Edge& edge : edges)
+            {
+                for(float sign = -1; sign <= 1; sign += 2)
+                {
+                    /* a centre is (x + r * dx , y + r * dy) , clip r to the band with a margin of one pixel */
+                    float dx = sign * edge.dx;
+                    float dy = sign * edge.dy;
+                    float low = static_cast<float>(minRadius);
+                    float high = static_cast<float>(maxRadius);
+                    if(!clip(edge.x, dx, -1.5f, w + 0.5f, low, high) ||
+                        !clip(edge.y, dy, top - 1.5f, bottom + 0.5f, low, high))
+                    {
+                        continue;
+                    }
+
+                    /* cells are checked again , which band votes a cell doesn't depend on rounding of the clipping */
+                    for(uint32_t r = static_cast<uint32_t>(std::ceil(low)); r <= static_cast<uint32_t>(high); r++)
+                    {
+                        uint32_t x = static_cast<uint32_t>(static_cast<int32_t>(edge.x + r * dx + 1.5f) - 1);
+                        uint32_t y = static_cast<uint32_t>(static_cast<int32_t>(edge.y + r * dy + 1.5f) - 1) - top;
+                        if(x < w && y < height)
+                        {
+                            band[static_cast<size_t>(y) * w + x]++;
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    /* centres are local maxima of votes , the same non-maximum suppression as houghLines */
+    std::vector<Circle> centres;
+    for(uint32_t y = 0; y < h; y++)
+    {
+        const uint32_t* row = &votes[static_cast<size_t>(y) * w];
+        const uint32_t* above = y > 0 ? row - w : nullptr;
+        const uint32_t* below = y + 1 < h ? row + w : nullptr;
+        for(uint32_t x = 0; x < w; x++)
+        {
+            uint32_t v = row[x];
+            if(v <= threshold)
+            {
+                continue;
+            }
+
+            bool peak = true;
+            uint64_t sum = 0;
+            int64_t sumX = 0;
+            int64_t sumY = 0;
+            for(int32_t d = -1; d <= 1 && peak; d++)
+            {
+                if((d < 0 && x == 0) || (d > 0 && x + 1 == w))
+                {
+                    continue;
+                }
+
+                peak = (above == nullptr || v > above[x + d]) &&
+                        (below == nullptr || v >= below[x + d]) &&
+                        (d == 0 || (d < 0 ? v > row[x + d] : v >= row[x + d]));
+
+                /* the centre is refined by the centroid of votes in 3 x 3 cells */
+                uint32_t column = (above != nullptr ? above[x + d] : 0) + row[x + d] + (below != nullptr ? below[x + d] : 0);
+                sum += column;
+                sumX += static_cast<int64_t>(column) * d;
+                sumY += static_cast<int64_t>(below != nullptr ? below[x + d] : 0) - (above != nullptr ? above[x + d] : 0);
+            }
+
+            if(peak)
+            {
+                Circle circle = {x + static_cast<double>(sumX) / sum, y + static_cast<double>(sumY) / sum, 0, v};
+                centres.push_back(circle);
+            }
+        }
+    }
+
+    std::stable_sort(centres.begin(), centres.end(), [](const Circle& a, const Circle& b)
+    {
+        return a.votes > b.votes;
+    });
+
+    /* drop centres near a stronger one */
+    double distance = minDistance * minDistance;
+    for(const Circle& centre : centres)
+    {
+        bool near = false;
+        for(const Circle& circle : result)
+        {
+            double dx = circle.x - centre.x;
+            double dy = circle.y - centre.y;
+            if(dx * dx + dy * dy < distance)
+            {
+                near = true;
+                break;
+            }
+        }
+
+        if(!near)
+        {
+            result.push_back(centre);
+        }
+    }
+
+    parallelFor(0, static_cast<uint32_t>(result.size()), 1, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t n = first; n < last; n++)
+        {
+            radius(edges, rows, minRadius, maxRadius, result[n]);
+        }
+    });
+
+    /* a centre without edge points around it is not a circle */
+    result.erase(std::remove_if(result.begin(), result.end(), [](const Circle& circle)
+    {
+        return circle.radius == 0;
+    }), result.end());
+    return result;
+}
+
+
+/**[Private]***********************************************************************************************/
+/*
+ * every band of rows votes into its own accumulator , so threads never share a counter ,
+ * and the accumulators are added at the end ;
+ * a band collects its edge points first and votes angle by angle , a row of the accumulator stays in cache
+ */
+template<typename Pixel>
+static std::vector<Line> lines(const Mat<Pixel>& edges, double rhoRes, double thetaRes, uint32_t threshold)
+{
+    std::vector<Line> result;
+    uint32_t w = edges.width();
+    uint32_t h = edges.height();
+    if(!(rhoRes > 0) || !(thetaRes > 0) || w == 0 || h == 0)
+    {
+        return result;
+    }
+
+    /* |rho| <= w + h , rho of the cell r is (r - offset) * rhoRes */
+    uint32_t angles = static_cast<uint32_t>(std::round(pi / thetaRes));
+    uint32_t offset = static_cast<uint32_t>(std::ceil((w + h) / rhoRes));
+    uint32_t cells = 2 * offset + 1;
+    angles = angles > 0 ? angles : 1;
+
+    /* tables are divided by rhoRes , offset and 0.5 make the rounded cell index positive before truncation */
+    std::vector<float> cosines(angles);
+    std::vector<float> sines(angles);
+    for(uint32_t n = 0; n < angles; n++)
+    {
+        cosines[n] = static_cast<float>(std::cos(n * thetaRes) / rhoRes);
+        sines[n] = static_cast<float>(std::sin(n * thetaRes) / rhoRes);
+    }
+    const float bias = offset + 0.5f;
+
+    uint32_t bands = threads() < h ? threads() : h;
+    std::vector<std::vector<uint32_t>> accumulators(bands);
+    parallelFor(0, bands, 1, [&](uint32_t first, uint32_t last)
+    {
+        std::vector<Point> points;
+        for(uint32_t b = first; b < last; b++)
+        {
+            uint32_t top = static_cast<uint64_t>(b) * h / bands;
+            uint32_t bottom = static_cast<uint64_t>(b + 1) * h / bands;
+            points.clear();
+            for(uint32_t y = top; y < bottom; y++)
+            {
+                const Pixel* pixels = &edges[y][0];
+                for(uint32_t x = 0; x < w; x++)
+                {
+                    if(isEdge(pixels[x]))
+                    {
+                        Point point = {static_cast<float>(x), static_cast<float>(y)};
+                        points.push_back(point);
+                    }
+                }
+            }
+
+            std::vector<uint32_t>& votes = accumulators[b];
+            votes.assign(static_cast<size_t>(angles) * cells, 0);
+            for(uint32_t n = 0; n < angles; n++)
+            {
+                uint32_t* row = &votes[static_cast<size_t>(n) * cells];
+                float c = cosines[n];
+                float s = sines[n];
+                for(const Point& point : points)
+                {
+                    row[static_cast<uint32_t>(point.x * c + point.y * s + bias)]++;
+                }
+            }
+        }
+    });
+
+    /* add all accumulators into the first one */
+    std::vector<uint32_t>& votes = accumulators[0];
+    parallelFor(0, angles, 8, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t b = 1; b < bands; b++)
+        {
+            const uint32_t* band = &accumulators[b][static_cast<size_t>(first) * cells];
+            uint32_t* sums = &votes[static_cast<size_t>(first) * cells];
+            for(size_t i = 0; i < static_cast<size_t>(last - first) * cells; i++)
+            {
+                sums[i] += band[i];
+            }
+        }
+    });
+
+    /*
+     * non-maximum suppression in 3 x 3 cells , a peak is greater than cells before it
+     * and not less than cells after it , so a plateau gives only one line
+     */
+    for(uint32_t n = 0; n < angles; n++)
+    {
+        const uint32_t* row = &votes[static_cast<size_t>(n) * cells];
+        const uint32_t* above = n > 0 ? row - cells : nullptr;
+        const uint32_t* below = n + 1 < angles ? row + cells : nullptr;
+        for(uint32_t r = 0; r < cells; r++)
+        {
+            uint32_t v = row[r];
+            if(v <= threshold)
+            {
+                continue;
+            }
+
+            bool peak = true;
+            for(int32_t d = -1; d <= 1 && peak; d++)
+            {
+                if((d < 0 && r == 0) || (d > 0 && r + 1 == cells))
+                {
+                    continue;
+                }
+
+                peak = (above == nullptr || v > above[r + d]) &&
+                        (below == nullptr || v >= below[r + d]) &&
+                        (d == 0 || (d < 0 ? v > row[r + d] : v >= row[r + d]));
+            }
+
+            if(peak)
+            {
+                Line line = {(static_cast<double>(r) - offset) * rhoRes, n * thetaRes, v};
+                result.push_back(line);
+            }
+        }
+    }
+
+    std::stable_sort(result.begin(), result.end(), [](const Line& a, const Line& b)
+    {
+        return a.votes > b.votes;
+    });
+    return result;
+}
+
+static bool isEdge(const RgbPixel& pixel)
+{
+    return pixel.red != 0;
+}
+
+static bool isEdge(uint8_t pixel)
+{
+    return pixel != 0;
+}
+
+/* Sobel operator , pixels on borders have no gradient */
+static void gradients(const GrayImage& src, std::vector<int16_t>& gx, std::vector<int16_t>& gy, std::vector<int16_t>& magnitudes)
+{
+    uint32_t w = src.width();
+    uint32_t h = src.height();
+    gx.assign(static_cast<size_t>(w) * h, 0);
+    gy.assign(static_cast<size_t>(w) * h, 0);
+    magnitudes.assign(static_cast<size_t>(w) * h, 0);
+    parallelFor(1, h - 1, 16, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t y = first; y < last; y++)
+        {
+            const uint8_t* above = &src[y - 1][0];
+            const uint8_t* row = &src[y][0];
+            const uint8_t* below = &src[y + 1][0];
+            int16_t* dx = &gx[static_cast<size_t>(y) * w];
+            int16_t* dy = &gy[static_cast<size_t>(y) * w];
+            int16_t* magnitude = &magnitudes[static_cast<size_t>(y) * w];
+            for(uint32_t x = 1; x + 1 < w; x++)
+            {
+                int32_t horizontal = (above[x + 1] + 2 * row[x + 1] + below[x + 1]) - (above[x - 1] + 2 * row[x - 1] + below[x - 1]);
+                int32_t vertical = (below[x - 1] + 2 * below[x] + below[x + 1]) - (above[x - 1] + 2 * above[x] + above[x + 1]);
+                dx[x] = static_cast<int16_t>(horizontal);
+                dy[x] = static_cast<int16_t>(vertical);
+                magnitude[x] = static_cast<int16_t>(std::abs(horizontal) + std::abs(vertical));
+            }
+        }
+    });
+}
+
+/*
+ * edge points are strong enough and the largest along the gradient , so an edge is one pixel wide ;
+ * points are in scan order , and points of the row y are edges[rows[y]] to edges[rows[y + 1]]
+ */
+static void edgePoints(const GrayImage& src, uint32_t edgeThreshold, std::vector<Edge>& edges, std::vector<uint32_t>& rows)
+{
+    uint32_t w = src.width();
+    uint32_t h = src.height();
+    std::vector<int16_t> gx;
+    std::vector<int16_t> gy;
+    std::vector<int16_t> magnitudes;
+    gradients(src, gx, gy, magnitudes);
+
+    uint32_t bands = threads() < h ? threads() : h;
+    std::vector<std::vector<Edge>> points(bands);
+    rows.assign(h + 1, 0);
+    parallelFor(0, bands, 1, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t b = first; b < last; b++)
+        {
+            uint32_t top = static_cast<uint64_t>(b) * h / bands;
+            uint32_t bottom = static_cast<uint64_t>(b + 1) * h / bands;
+            for(uint32_t y = top; y < bottom; y++)
+            {
+                rows[y + 1] = static_cast<uint32_t>(points[b].size());
+                if(y == 0 || y + 1 == h)
+                {
+                    continue;
+                }
+
+                const int16_t* magnitude = &magnitudes[static_cast<size_t>(y) * w];
+                const int16_t* dx = &gx[static_cast<size_t>(y) * w];
+                const int16_t* dy = &gy[static_cast<size_t>(y) * w];
+                for(uint32_t x = 1; x + 1 < w; x++)
+                {
+                    int32_t m = magnitude[x];
+                    if(m < static_cast<int32_t>(edgeThreshold) || m == 0)
+                    {
+                        continue;
+                    }
+
+                    /* neighbours along the gradient quantized into 4 directions , tan(67.5) = 2.414 */
+                    int32_t ax = std::abs(dx[x]);
+                    int32_t ay = std::abs(dy[x]);
+                    ptrdiff_t step;
+                    if(ay * 2414 < ax * 1000)
+                    {
+                        step = 1;
+                    }
+                    else if(ax * 2414 < ay * 1000)
+                    {
+                        step = w;
+                    }
+                    else
+                    {
+                        step = (dx[x] < 0) == (dy[x] < 0) ? w + 1 : w - 1;
+                    }
+
+                    if(m <= magnitude[x - step] || m < magnitude[x + step])
+                    {
+                        continue;
+                    }
+
+                    float length = std::sqrt(static_cast<float>(dx[x] * dx[x] + dy[x] * dy[x]));
+                    Edge edge = {static_cast<float>(x), static_cast<float>(y), dx[x] / length, dy[x] / length};
+                    points[b].push_back(edge);
+                }
+                rows[y + 1] = static_cast<uint32_t>(points[b].size());
+            }
+        }
+    });
+
+    /* concatenate bands , counts of rows become offsets */
+    edges.clear();
+    for(uint32_t b = 0; b < bands; b++)
+    {
+        uint32_t top = static_cast<uint64_t>(b) * h / bands;
+        uint32_t bottom = static_cast<uint64_t>(b + 1) * h / bands;
+        uint32_t offset = static_cast<uint32_t>(edges.size());
+        for(uint32_t y = top; y < bottom; y++)
+        {
+            rows[y + 1] += offset;
+        }
+        rows[top] = offset;
+        edges.insert(edges.end(), points[b].begin(), points[b].end());
+    }
+}
+
+/* narrow [first, last] to values of r where position + r * direction is in [low, high] */
+static bool clip(float position, float direction, float low, float high, float& first, float& last)
+{
+    if(direction == 0)
+    {
+        return position >= low && position <= high && first <= last;
+    }
+
+    float a = (low - position) / direction;
+    float b = (high - position) / direction;
+    first = std::max(first, std::min(a, b));
+    last = std::min(last, std::max(a, b));
+    return first <= last;
+}
+
+/*
+ * distances from the centre to edge points whose gradient points to the centre are counted ,
+ * points at the 3 neighbouring distances with the most points are on the circle ;
+ * the centre is moved to the point nearest to their gradient lines by least squares ,
+ * and the radius is their mean distance from it
+ */
+static void radius(const std::vector<Edge>& edges, const std::vector<uint32_t>& rows,
+                    uint32_t minRadius, uint32_t maxRadius, Circle& circle)
+{
+    uint32_t h = static_cast<uint32_t>(rows.size() - 1);
+    std::vector<uint32_t> histogram(maxRadius + 2, 0);
+    double reach = maxRadius + 0.5;
+    uint32_t top = static_cast<uint32_t>(std::max(0.0, std::ceil(circle.y - reach)));
+    uint32_t bottom = static_cast<uint32_t>(std::min(h - 1.0, std::floor(circle.y + reach)));
+    for(uint32_t y = top; y <= bottom; y++)
+    {
+        for(uint32_t n = rows[y]; n < rows[y + 1]; n++)
+        {
+            const Edge& edge = edges[n];
+            double dx = edge.x - circle.x;
+            double dy = edge.y - circle.y;
+            double distance = std::sqrt(dx * dx + dy * dy);
+            uint32_t r = static_cast<uint32_t>(distance + 0.5);
+            if(r < minRadius || r > maxRadius || std::abs(dx * edge.dx + dy * edge.dy) < 0.9 * distance)
+            {
+                continue;
+            }
+            histogram[r]++;
+        }
+    }
+
+    uint32_t best = 0;
+    uint32_t most = 0;
+    for(uint32_t r = minRadius; r <= maxRadius; r++)
+    {
+        uint32_t count = histogram[r - 1] + histogram[r] + histogram[r + 1];
+        if(count > most)
+        {
+            best = r;
+            most = count;
+        }
+    }
+
+    if(most == 0)
+    {
+        return;
+    }
+
+    /* a gradient line through p with direction u is 0 = (I - u * u') * (c - p) , sum them up and solve for c */
+    double xx = 0, xy = 0, yy = 0, bx = 0, by = 0;
+    for(uint32_t y = top; y <= bottom; y++)
+    {
+        for(uint32_t n = rows[y]; n < rows[y + 1]; n++)
+        {
+            const Edge& edge = edges[n];
+            double dx = edge.x - circle.x;
+            double dy = edge.y - circle.y;
+            double distance = std::sqrt(dx * dx + dy * dy);
+            uint32_t r = static_cast<uint32_t>(distance + 0.5);
+            if(r + 1 < best || r > best + 1 || std::abs(dx * edge.dx + dy * edge.dy) < 0.9 * distance)
+            {
+                continue;
+            }
+
+            double a = 1 - edge.dx * edge.dx;
+            double b = -edge.dx * edge.dy;
+            double c = 1 - edge.dy * edge.dy;
+            xx += a;
+            xy += b;
+            yy += c;
+            bx += a * edge.x + b * edge.y;
+            by += b * edge.x + c * edge.y;
+        }
+    }
+
+    /* points of a short arc are nearly parallel , keep the centre of votes then */
+    double determinant = xx * yy - xy * xy;
+    if(determinant > 1e-3 * (xx + yy) * (xx + yy))
+    {
+        double x = (yy * bx - xy * by) / determinant;
+        double y = (xx * by - xy * bx) / determinant;
+        if(std::abs(x - circle.x) <= 2 && std::abs(y - circle.y) <= 2)
+        {
+            circle.x = x;
+            circle.y = y;
+        }
+    }
+
+    double sum = 0;
+    uint32_t count = 0;
+    for(uint32_t y = top; y <= bottom; y++)
+    {
+        for(uint32_t n = rows[y]; n < rows[y + 1]; n++)
+        {
+            const Edge& edge = edges[n];
+            double dx = edge.x - circle.x;
+            double dy = edge.y - circle.y;
+            double distance = std::sqrt(dx * dx + dy * dy);
+            if(std::abs(distance - best) <= 1.5 && std::abs(dx * edge.dx + dy * edge.dy) >= 0.9 * distance)
+            {
+                sum += distance;
+                count++;
+            }
+        }
+    }
+    circle.radius = count > 0 ? sum / count : best;
+}
+
+}; // namespace lolita
@@ -0,0 +1,58 @@
+/* Hough transform , find lines in edge maps and circles in images */
+#ifndef LOLITA_HOUGH_H
+#define LOLITA_HOUGH_H
+
+#include <cstdint>
+#include <vector>
+#include "mat.hpp"
+
+namespace lolita
+{
+
+/* x * cos(theta) + y * sin(theta) = rho , the origin is the top-left pixel */
+struct Line
+{
+    double rho;             // distance from the origin , may be negative
+    double theta;           // angle of the normal in radian , [0, pi)
+    uint32_t votes;         // edge pixels on the line
+};
+
+struct Circle
+{
+    double x;               // centre
+    double y;
+    double radius;
+    uint32_t votes;         // edge pixels whose gradient line passes through the centre
+};
+
+/*
+ * Non-zero pixels are edge points , such as the output of detectEdge and binaryzation ,
+ * only red is checked in an Image.
+ * rhoRes is in pixels and thetaRes is in radian , a line needs more than threshold votes ;
+ * lines are local maxima of votes , sorted by votes from the most.
+ *
+ *     GrayImage edges;
+ *     grayScale(src, edges);
+ *     detectEdge(edges);
+ *     binaryzation(edges);
+ *     std::vector<Line> lines = houghLines(edges, 1, M_PI / 180, 100);
+ */
+std::vector<Line> houghLines(const Image& edges, double rhoRes, double thetaRes, uint32_t threshold);
+std::vector<Line> houghLines(const GrayImage& edges, double rhoRes, double thetaRes, uint32_t threshold);
+
+/*
+ * Edge points are pixels whose Sobel gradient |gx| + |gy| is at least edgeThreshold and the largest
+ * across the edge ; every edge point votes for centres on its gradient line , minRadius to maxRadius away
+ * in both directions , so the accumulator is as large as the image ;
+ * a centre needs more than threshold votes , and centres closer than minDistance to a stronger one are dropped ,
+ * then its radius is the distance from most edge points around it , within [minRadius, maxRadius].
+ * Circles are sorted by votes from the most , only luma of an Image is used.
+ */
+std::vector<Circle> houghCircles(const Image& src, uint32_t minRadius, uint32_t maxRadius, uint32_t threshold,
+                                    double minDistance, uint32_t edgeThreshold = 100);
+std::vector<Circle> houghCircles(const GrayImage& src, uint32_t minRadius, uint32_t maxRadius, uint32_t threshold,
+                                    double minDistance, uint32_t edgeThreshold = 100);
+
+}; // namespace lolita
+
+#endif
@@ -5,5 +5,10 @@
 #include "mat.hpp"
 #include "bmp.h"
 #include "tools.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "fft.h"
+#include "hough.h"
+#include "warp.h"
 
 #endif
\ No newline at end of file
@@ -4,10 +4,13 @@
 #include <cstddef>
 #include <cstdint>
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <iostream>
 #include <cstdlib>
 #include <cstring>
+#include <new>
+#include <stdexcept>
 
 namespace lolita
 {
@@ -40,47 +43,109 @@ private:
     ElemType* data_;
 };
 
+/* elements shared by copies of a Mat , they are copied on the first mutable access */
+struct MatBlock
+{
+    std::atomic<uint32_t> refs;     // count of Mats keeping it , owners and views , it's freed at 0
+    std::atomic<uint32_t> owners;   // count of Mats owning it , views are not counted
+    std::atomic<uint32_t> views;    // count of writable views , copies can't share it while there are any
+};
+
 template<typename ElemType>
 class Mat
 {
 public:
+    /* row starts are aligned to this , so that rows can be loaded by SIMD */
+    static const size_t alignment = 64;
+
     ~Mat()
     {
-        if(data_ != nullptr)
-        {
-            free(data_);
-            data_ = nullptr;
-        }
+        release();
     }
 
-    Mat(uint32_t width = 0, uint32_t height = 0)
+    Mat(uint32_t width = 0, uint32_t height = 0):
+        block_(nullptr),
+        data_(nullptr),
+        step_(0),
+        width_(0),
+        height_(0),
+        kind_(Kind::Owner)
     {
-        this->width_  = width;
-        this->height_ = height;
-        void* data = malloc(sizeof(ElemType) * width * height);
-        this->data_ = reinterpret_cast<ElemType*>(data);
+        allocate(width, height);
+    }
+
+    /* a view of external data , rows are step bytes apart , step may be negative */
+    Mat(uint32_t width, uint32_t height, ElemType* data, ptrdiff_t step):
+        block_(nullptr),
+        data_(data),
+        step_(step),
+        width_(width),
+        height_(height),
+        kind_(Kind::View)
+    {
+
     }
 
-    Mat(const Mat& another)
+    /* shares elements with another , but copy of a view is a new image , not a view */
+    Mat(const Mat& another):
+        block_(nullptr),
+        data_(nullptr),
+        step_(0),
+        width_(0),
+        height_(0),
+        kind_(Kind::Owner)
     {
-        size_t n = sizeof(ElemType) * another.width_ * another.height_;
-        void* data = malloc(n);
-        if(data == nullptr)
+        assign(another);
+    }
+
+    Mat(Mat&& another):
+        block_(nullptr),
+        data_(nullptr),
+        step_(0),
+        width_(0),
+        height_(0),
+        kind_(Kind::Owner)
+    {
+        swap(another);
+    }
+
+    /*
+     * a writable view of the same size copies elements in place , so assigning to a view writes through it ,
+     * both by copy and by move ; otherwise this Mat takes the elements of another ,
+     * another may be a view of this Mat , so the old elements are released after taking the new ones
+     */
+    Mat& operator = (const Mat& another)
+    {
+        if(this != &another)
         {
-            throw std::bad_alloc();
+            if(writesThrough(another))
+            {
+                copyThrough(another);
+            }
+            else
+            {
+                Mat temp(another);
+                swap(temp);
+            }
         }
-        memcpy(data, another.data_, n);
-        this->data_ = reinterpret_cast<ElemType*>(data);
-        this->width_ = another.width_;
-        this->height_ = another.height_;
+        return *this;
     }
 
-    Mat(Mat&& another)
+    Mat& operator = (Mat&& another)
     {
-        data_ = another.data_;
-        this->width_ = another.width_;
-        this->height_ = another.height_;
-        another.data_ = nullptr;
+        if(this != &another)
+        {
+            if(writesThrough(another))
+            {
+                copyThrough(another);
+            }
+            else
+            {
+                Mat temp(std::move(another));
+                swap(temp);
+            }
+        }
+        return *this;
     }
 
     uint32_t width() const
@@ -93,48 +158,290 @@ public:
         return height_;
     }
 
+    /* bytes from a row to the next one */
+    ptrdiff_t step() const
+    {
+        return step_;
+    }
+
+    /* true if this Mat doesn't own its elements */
+    bool isView() const
+    {
+        return kind_ != Kind::Owner;
+    }
+
+    /*
+     * true if elements are shared with other Mats , they will be copied on the first mutable access ;
+     * a view returned by const roi is always shared
+     */
+    bool isShared() const
+    {
+        return kind_ == Kind::ConstView ||
+                (kind_ == Kind::Owner && block_ != nullptr && block_->owners.load(std::memory_order_acquire) > 1);
+    }
+
+    /* true if there are writable views of the elements , in-place operators write through to them */
+    bool hasViews() const
+    {
+        return block_ != nullptr && block_->views.load(std::memory_order_acquire) > 0;
+    }
+
+    /* 
+     * make elements owned by this Mat only , mutable accesses do it by themselves ,
+     * call it before accessing a Mat from several threads
+     */
+    void detach()
+    {
+        if(isShared())
+        {
+            Mat temp(width_, height_);
+            temp.copyFrom(*this);
+            *this = std::move(temp);
+        }
+    }
+
+    /*
+     * WARNING : a row or a pointer taken from a mutable access is not tracked ,
+     * if this Mat is copied later , writing through it changes the copy too ;
+     * take them again after copying , or detach() the copy before using them
+     */
     MatRowView<ElemType> operator [] (uint32_t raw)
     {
-    	return MatRowView<ElemType>(data_ + raw * width_);
+        detach();
+    	return MatRowView<ElemType>(row(raw));
     }
 
     const MatRowView<ElemType> operator [] (uint32_t raw) const
     {
-    	return MatRowView<ElemType>(data_ + raw * width_);
+    	return MatRowView<ElemType>(row(raw));
+    }
+
+    /*
+     * a view of the rectangle (x, y, width, height) , it keeps the elements alive ,
+     * but it doesn't see them anymore once this Mat takes other elements ;
+     * copies of this Mat don't share elements while there are views
+     */
+    Mat roi(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+    {
+        check(x, y, width, height);
+        detach();
+        return view(x, y, width, height, Kind::View);
+    }
+
+    /* a read-only view , it doesn't detach this Mat , and it copies its elements on the first mutable access */
+    const Mat roi(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const
+    {
+        check(x, y, width, height);
+        return view(x, y, width, height, Kind::ConstView);
     }
 
+    /* a view of the same size keeps its elements , otherwise the overlapped elements are kept */
     void resize(uint32_t width, uint32_t height)
     {
-        this->width_  = width;
-        this->height_ = height;
-        void* data = reinterpret_cast<void*>(data_);
-        data = realloc(data, sizeof(ElemType) * width * height);
-        this->data_ = reinterpret_cast<ElemType*>(data);
+        if(width == width_ && height == height_)
+        {
+            return;
+        }
+
+        Mat temp(width, height);
+        uint32_t w = std::min(width, width_);
+        uint32_t h = std::min(height, height_);
+        for(uint32_t y = 0; y < h; y++)
+        {
+            memcpy(temp.row(y), row(y), sizeof(ElemType) * w);
+        }
+        *this = std::move(temp);
     }
 
     void map(std::function<void(ElemType&)> callback)
     {
-        for(uint32_t i = 0; i < width_ * height_; i++)
+        detach();
+        for(uint32_t y = 0; y < height_; y++)
         {
-            callback(*(data_ + i)); 
+            ElemType* elements = row(y);
+            for(uint32_t x = 0; x < width_; x++)
+            {
+                callback(elements[x]); 
+            }
         }
     }
     
     template<typename T>
     T reduce(std::function<T(ElemType&)> callback)
     {
+        detach();
         T n = 0;
-        for(uint32_t i = 0; i < width_ * height_; i++)
+        for(uint32_t y = 0; y < height_; y++)
         {
-            n += callback(*(data_ + i)); 
+            ElemType* elements = row(y);
+            for(uint32_t x = 0; x < width_; x++)
+            {
+                n += callback(elements[x]); 
+            }
         }
         return n;
     }
 
 private:
-    ElemType* data_;
+    enum class Kind : uint8_t
+    {
+        Owner,          // owns its elements , maybe shared with copies
+        View,           // writes through to the elements of another
+        ConstView,      // reads the elements of another , copies them on the first mutable access
+    };
+
+    void check(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const
+    {
+        if(static_cast<uint64_t>(x) + width > width_ || static_cast<uint64_t>(y) + height > height_)
+        {
+            throw std::out_of_range("Mat::roi");
+        }
+    }
+
+    /* only writable views hold copies from sharing elements */
+    Mat view(uint32_t x, uint32_t y, uint32_t width, uint32_t height, Kind kind) const
+    {
+        Mat result(width, height, row(y) + x, step_);
+        result.kind_ = kind;
+        result.block_ = block_;
+        if(block_ != nullptr)
+        {
+            block_->refs++;
+            if(kind == Kind::View)
+            {
+                block_->views++;
+            }
+        }
+        return result;
+    }
+
+    ElemType* row(uint32_t raw) const
+    {
+        return reinterpret_cast<ElemType*>(reinterpret_cast<uint8_t*>(data_) + static_cast<ptrdiff_t>(raw) * step_);
+    }
+
+    /* block header and elements are in one allocation , elements start at an aligned address */
+    void allocate(uint32_t width, uint32_t height)
+    {
+        size_t step = (sizeof(ElemType) * width + alignment - 1) / alignment * alignment;
+        size_t n = step * height;
+        if(n == 0)
+        {
+            this->width_ = width;
+            this->height_ = height;
+            return;
+        }
+
+        void* memory = malloc(sizeof(MatBlock) + alignment - 1 + n);
+        if(memory == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+
+        MatBlock* block = new(memory) MatBlock;
+        block->refs = 1;
+        block->owners = 1;
+        block->views = 0;
+
+        uintptr_t address = reinterpret_cast<uintptr_t>(block + 1);
+        address = (address + alignment - 1) / alignment * alignment;
+        this->block_ = block;
+        this->data_ = reinterpret_cast<ElemType*>(address);
+        this->step_ = step;
+        this->width_ = width;
+        this->height_ = height;
+    }
+
+    void assign(const Mat& another)
+    {
+        if(another.kind_ == Kind::Owner && another.block_ != nullptr && another.block_->views.load() == 0)
+        {
+            another.block_->owners++;
+            another.block_->refs++;
+            block_ = another.block_;
+            data_ = another.data_;
+            step_ = another.step_;
+            width_ = another.width_;
+            height_ = another.height_;
+        }
+        else
+        {
+            allocate(another.width_, another.height_);
+            copyFrom(another);
+        }
+    }
+
+    void release()
+    {
+        if(block_ != nullptr)
+        {
+            if(kind_ == Kind::Owner)
+            {
+                block_->owners--;
+            }
+            else if(kind_ == Kind::View)
+            {
+                block_->views--;
+            }
+
+            if(--block_->refs == 0)
+            {
+                block_->~MatBlock();
+                free(block_);
+            }
+        }
+        block_ = nullptr;
+        data_ = nullptr;
+        step_ = 0;
+        width_ = 0;
+        height_ = 0;
+        kind_ = Kind::Owner;
+    }
+
+    void swap(Mat& another)
+    {
+        std::swap(block_, another.block_);
+        std::swap(data_, another.data_);
+        std::swap(step_, another.step_);
+        std::swap(width_, another.width_);
+        std::swap(height_, another.height_);
+        std::swap(kind_, another.kind_);
+    }
+
+    bool writesThrough(const Mat& another) const
+    {
+        return kind_ == Kind::View && width_ == another.width_ && height_ == another.height_;
+    }
+
+    /* another may overlap this view , then it's copied first */
+    void copyThrough(const Mat& another)
+    {
+        if(block_ != nullptr && block_ == another.block_)
+        {
+            Mat temp(another.width_, another.height_);
+            temp.copyFrom(another);
+            copyFrom(temp);
+        }
+        else
+        {
+            copyFrom(another);
+        }
+    }
+
+    void copyFrom(const Mat& another)
+    {
+        for(uint32_t y = 0; y < height_; y++)
+        {
+            memcpy(row(y), another.row(y), sizeof(ElemType) * width_);
+        }
+    }
+
+    MatBlock* block_;       // nullptr for empty Mats and views of external data
+    ElemType* data_;        // first element of the first row
+    ptrdiff_t step_;
     uint32_t width_;
     uint32_t height_;
+    Kind kind_;             // views keep the block alive but never own it
 };
 
 /************************************************************************************************/
@@ -150,6 +457,24 @@ namespace lolita
     using HsvImage = Mat<HsvPixel>;
     using Image = RgbImage;
 
+    /* compact images , 1 byte per channel */
+    using GrayImage = Mat<uint8_t>;
+    using Rgb24Image = Mat<Rgb24Pixel>;
+    using Rgba32Image = Mat<Rgba32Pixel>;
+
+    template<typename From, typename To, typename Convert>
+    inline void convertImage(const Mat<From>& src, Mat<To>& dst, Convert convert)
+    {
+        dst.resize(src.width(), src.height());
+        for(uint32_t y = 0; y < src.height(); y++)
+        {
+            for(uint32_t x = 0; x < src.width(); x++)
+            {
+                dst[y][x] = convert(src[y][x]);
+            }
+        }
+    }
+
     inline void convertRgb2Hsv(const RgbImage& src, HsvImage& dst)
     {
         dst.resize(src.width(), src.height());
@@ -174,6 +499,41 @@ namespace lolita
             }
         }
     }
+
+    inline void convertRgb2Gray(const RgbImage& src, GrayImage& dst)
+    {
+        convertImage(src, dst, rgb2gray);
+    }
+
+
+    inline void convertGray2Rgb(const GrayImage& src, RgbImage& dst)
+    {
+        convertImage(src, dst, gray2rgb);
+    }
+
+
+    inline void convertRgb2Packed(const RgbImage& src, Rgb24Image& dst)
+    {
+        convertImage(src, dst, pack24);
+    }
+
+
+    inline void convertRgb2Packed(const RgbImage& src, Rgba32Image& dst)
+    {
+        convertImage(src, dst, pack32);
+    }
+
+
+    inline void convertPacked2Rgb(const Rgb24Image& src, RgbImage& dst)
+    {
+        convertImage(src, dst, [](Rgb24Pixel pix){return unpack(pix);});
+    }
+
+
+    inline void convertPacked2Rgb(const Rgba32Image& src, RgbImage& dst)
+    {
+        convertImage(src, dst, [](Rgba32Pixel pix){return unpack(pix);});
+    }
 }; // namespace lolita
 
 
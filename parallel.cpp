@@ -0,0 +1,353 @@
+#include "parallel.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lolita
+{
+
+/**[Private]***********************************************************************************************/
+struct Job
+{
+    const std::function<void(uint32_t, uint32_t)>* body;
+    std::atomic<uint32_t> pending;      // decreased under mutex , so the owner can wait on done
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+};
+
+struct Task
+{
+    Job* job;
+    uint32_t begin;
+    uint32_t end;
+};
+
+/* every thread pops at the back of its own deque , and steals at the front of others */
+struct Queue
+{
+    std::mutex mutex;
+    std::deque<Task> tasks;
+};
+
+class ThreadPool
+{
+public:
+    ~ThreadPool();
+
+    static ThreadPool& instance();
+
+    void resize(uint32_t count);
+    void stop();
+    uint32_t size() const;
+    void run(uint32_t begin, uint32_t end, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& body);
+
+private:
+    /* counts a call from out of the pool , resize waits until no such call is running */
+    class Usage
+    {
+    public:
+        Usage(ThreadPool& pool);
+        ~Usage();
+
+    private:
+        ThreadPool& pool_;
+        bool outer_;
+    };
+
+    ThreadPool();
+
+    void start(uint32_t count);
+    void work(uint32_t index);
+    uint32_t self() const;
+    bool take(uint32_t index, Task& task);
+    void execute(Task& task);
+
+    std::atomic<uint32_t> count_;
+    std::vector<std::unique_ptr<Queue>> queues_;    // last one is shared by threads out of the pool
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::atomic<uint32_t> queued_;
+    bool stopping_;
+
+    std::condition_variable idle_;
+    uint32_t users_;
+    bool resizing_;
+};
+
+static thread_local int32_t workerIndex = -1;
+static thread_local bool running = false;       // this thread is inside parallelFor
+
+
+/**********************************************************************************************************/
+void setThreads(uint32_t count)
+{
+    ThreadPool::instance().resize(count);
+}
+
+uint32_t threads()
+{
+    return ThreadPool::instance().size();
+}
+
+void parallelFor(uint32_t begin, uint32_t end, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& body)
+{
+    ThreadPool::instance().run(begin, end, grain, body);
+}
+
+
+/**[Private]***********************************************************************************************/
+ThreadPool::ThreadPool():
+    count_(0),
+    queued_(0),
+    stopping_(false),
+    users_(0),
+    resizing_(false)
+{
+    start(0);
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+ThreadPool& ThreadPool::instance()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::start(uint32_t count)
+{
+    if(count == 0)
+    {
+        count = std::thread::hardware_concurrency();
+        count = count > 0 ? count : 1;
+    }
+
+    count_ = count;
+    stopping_ = false;
+    queues_.clear();
+    for(uint32_t i = 0; i < count; i++)
+    {
+        queues_.emplace_back(new Queue);
+    }
+
+    /* the caller of parallelFor works too , so start count - 1 threads */
+    for(uint32_t i = 0; i + 1 < count; i++)
+    {
+        workers_.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+void ThreadPool::resize(uint32_t count)
+{
+    /* block new calls first , so a stream of calls can't starve resize */
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]{ return !resizing_; });
+    resizing_ = true;
+    idle_.wait(lock, [this]{ return users_ == 0; });
+    lock.unlock();
+
+    stop();
+    start(count);
+
+    lock.lock();
+    resizing_ = false;
+    lock.unlock();
+    idle_.notify_all();
+}
+
+void ThreadPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+
+    for(std::thread& worker : workers_)
+    {
+        worker.join();
+    }
+    workers_.clear();
+}
+
+uint32_t ThreadPool::size() const
+{
+    return count_;
+}
+
+void ThreadPool::run(uint32_t begin, uint32_t end, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& body)
+{
+    if(begin >= end)
+    {
+        return;
+    }
+
+    Usage usage(*this);
+    grain = grain > 0 ? grain : 1;
+    uint32_t length = end - begin;
+    if(count_ <= 1 || length <= grain)
+    {
+        body(begin, end);
+        return;
+    }
+
+    /* a few chunks for each thread , so that threads which finish early can steal */
+    uint32_t chunks = (length + grain - 1) / grain;
+    chunks = chunks < count_ * 4 ? chunks : count_ * 4;
+    uint32_t step = (length + chunks - 1) / chunks;
+    chunks = (length + step - 1) / step;
+
+    Job job;
+    job.body = &body;
+    job.pending = chunks;
+
+    /* count before pushing , so queued_ never goes below the real count of tasks */
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_ += chunks;
+    }
+
+    uint32_t index = self();
+    for(uint32_t i = 0; i < chunks; i++)
+    {
+        Task task = {&job, begin + i * step, begin + i * step + step < end ? begin + i * step + step : end};
+        Queue& queue = *queues_[(index + i) % count_];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+    wake_.notify_all();
+
+    /* help until no chunk can be taken , maybe run chunks of other jobs meanwhile */
+    Task task;
+    while(job.pending.load() > 0 && take(index, task))
+    {
+        execute(task);
+    }
+
+    /* the rest are running on other threads , always lock so the last one has released the mutex */
+    {
+        std::unique_lock<std::mutex> lock(job.mutex);
+        job.done.wait(lock, [&job]{ return job.pending.load() == 0; });
+    }
+
+    if(job.error)
+    {
+        std::rethrow_exception(job.error);
+    }
+}
+
+void ThreadPool::work(uint32_t index)
+{
+    workerIndex = index;
+    while(true)
+    {
+        Task task;
+        if(take(index, task))
+        {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this]{ return stopping_ || queued_.load() > 0; });
+        if(stopping_ && queued_.load() == 0)
+        {
+            return;
+        }
+    }
+}
+
+uint32_t ThreadPool::self() const
+{
+    return workerIndex >= 0 ? workerIndex : count_ - 1;
+}
+
+bool ThreadPool::take(uint32_t index, Task& task)
+{
+    for(uint32_t i = 0; i < count_; i++)
+    {
+        Queue& queue = *queues_[(index + i) % count_];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.tasks.empty())
+        {
+            continue;
+        }
+
+        if(i == 0)
+        {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        queued_--;
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::execute(Task& task)
+{
+    Job* job = task.job;
+    try
+    {
+        (*job->body)(task.begin, task.end);
+    }
+    catch(...)
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->error = std::current_exception();
+    }
+
+    /* job may be destroyed by its owner as soon as pending becomes 0 and the mutex is released */
+    std::lock_guard<std::mutex> lock(job->mutex);
+    if(--job->pending == 0)
+    {
+        job->done.notify_all();
+    }
+}
+
+ThreadPool::Usage::Usage(ThreadPool& pool):
+    pool_(pool),
+    outer_(workerIndex < 0 && !running)
+{
+    /* nested calls run inside an outer call , workers run chunks of one */
+    if(outer_)
+    {
+        std::unique_lock<std::mutex> lock(pool_.mutex_);
+        pool_.idle_.wait(lock, [this]{ return !pool_.resizing_; });
+        pool_.users_++;
+        running = true;
+    }
+}
+
+ThreadPool::Usage::~Usage()
+{
+    if(outer_)
+    {
+        running = false;
+        std::unique_lock<std::mutex> lock(pool_.mutex_);
+        if(--pool_.users_ == 0)
+        {
+            lock.unlock();
+            pool_.idle_.notify_all();
+        }
+    }
+}
+
+}; // namespace lolita
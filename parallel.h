@@ -0,0 +1,27 @@
+/* Thread pool shared by all operators */
+#ifndef LOLITA_PARALLEL_H
+#define LOLITA_PARALLEL_H
+
+#include <cstdint>
+#include <functional>
+
+namespace lolita
+{
+
+/*
+ * count of threads , 0 means count of CPU cores , 1 runs everything on the caller ;
+ * it waits until running parallelFor calls return , and calls from other threads wait for it ,
+ * so it must not be called from inside a body of parallelFor
+ */
+void setThreads(uint32_t count);
+uint32_t threads();
+
+/*
+ * split [begin, end) into chunks of at least grain indexes and invoke body(chunkBegin, chunkEnd)
+ * on the pool , return after all chunks are done ; it can be called from inside a chunk
+ */
+void parallelFor(uint32_t begin, uint32_t end, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& body);
+
+}; // namespace lolita
+
+#endif
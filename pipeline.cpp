@@ -0,0 +1,220 @@
+#include "pipeline.h"
+#include "tools.h"
+#include "parallel.h"
+#include <cstring>
+
+namespace lolita
+{
+
+/**[Private]***********************************************************************************************/
+/* side of tiles , a tile of RgbPixel and its halo stay in L2 cache */
+static const uint32_t tileSide = 128;
+
+/* a view for reading , src is not written through it */
+static Image view(const Image& src, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+
+/**********************************************************************************************************/
+Pipeline& Pipeline::gray()
+{
+    return push(0, false, [](const Image& src, Image& dst)
+    {
+        grayScale(src, dst);
+    });
+}
+
+/* threshold 0 means Kittler Algorithm , it needs the whole image */
+Pipeline& Pipeline::threshold(uint8_t threshold)
+{
+    return push(0, threshold == 0, [threshold](const Image& src, Image& dst)
+    {
+        binaryzation(src, dst, threshold);
+    });
+}
+
+Pipeline& Pipeline::edge()
+{
+    return push(1, false, [](const Image& src, Image& dst)
+    {
+        detectEdge(src, dst);
+    });
+}
+
+Pipeline& Pipeline::blur(uint32_t radius)
+{
+    return push(radius, false, [radius](const Image& src, Image& dst)
+    {
+        averageBlur(src, dst, radius);
+    });
+}
+
+Pipeline& Pipeline::median(uint32_t radius)
+{
+    return push(radius, false, [radius](const Image& src, Image& dst)
+    {
+        medianBlur(src, dst, radius);
+    });
+}
+
+Pipeline& Pipeline::gauss(uint32_t radius, double variance)
+{
+    return push(radius, false, [radius, variance](const Image& src, Image& dst)
+    {
+        gaussianBlur(src, dst, radius, variance);
+    });
+}
+
+Pipeline& Pipeline::erode(uint32_t radius)
+{
+    return push(radius, false, [radius](const Image& src, Image& dst)
+    {
+        lolita::erode(src, dst, radius);
+    });
+}
+
+Pipeline& Pipeline::dilate(uint32_t radius)
+{
+    return push(radius, false, [radius](const Image& src, Image& dst)
+    {
+        lolita::dilate(src, dst, radius);
+    });
+}
+
+void Pipeline::clear()
+{
+    stages_.clear();
+}
+
+size_t Pipeline::size() const
+{
+    return stages_.size();
+}
+
+void Pipeline::run(const Image& src, Image& dst) const
+{
+    if(&src == &dst)
+    {
+        const Image temp = src;
+        run(temp, dst);
+        return;
+    }
+
+    /* global stages split the pipeline , they run on the whole image left by the tiles before them */
+    Image image;
+    const Image* input = &src;
+    size_t begin = 0;
+    for(size_t i = 0; i < stages_.size(); i++)
+    {
+        if(!stages_[i].global)
+        {
+            continue;
+        }
+
+        Image part;
+        if(begin < i)
+        {
+            runTiles(*input, part, begin, i);
+        }
+        else
+        {
+            part = *input;
+        }
+        stages_[i].apply(part, part);
+        image = std::move(part);
+        input = &image;
+        begin = i + 1;
+    }
+
+    if(begin < stages_.size())
+    {
+        runTiles(*input, dst, begin, stages_.size());
+    }
+    else
+    {
+        dst = *input;
+    }
+}
+
+
+/**[Private]***********************************************************************************************/
+Pipeline& Pipeline::push(uint32_t radius, bool global, std::function<void(const Image&, Image&)> apply)
+{
+    Stage stage = {radius, global, apply};
+    stages_.push_back(stage);
+    return *this;
+}
+
+/* run stages [begin, end) , none of them is global */
+void Pipeline::runTiles(const Image& src, Image& dst, size_t begin, size_t end) const
+{
+    uint32_t w = src.width();
+    uint32_t h = src.height();
+    if(dst.width() != w || dst.height() != h || dst.isShared())
+    {
+        dst = Image(w, h);
+    }
+    if(w == 0 || h == 0)
+    {
+        return;
+    }
+
+    /* halo[k] is pixels needed around a tile by stage (begin + k) and the stages after it */
+    std::vector<uint32_t> halo(end - begin + 1, 0);
+    uint32_t side = tileSide;
+    for(size_t k = end; k > begin; k--)
+    {
+        uint32_t radius = stages_[k - 1].radius;
+        halo[k - 1 - begin] = halo[k - begin] + radius;
+
+        /* a tile is never smaller than a kernel , otherwise filters skip it */
+        side = 2 * radius + 1 > side ? 2 * radius + 1 : side;
+    }
+
+    uint32_t columns = w / side > 0 ? w / side : 1;
+    uint32_t rows = h / side > 0 ? h / side : 1;
+    parallelFor(0, columns * rows, 1, [&](uint32_t first, uint32_t last)
+    {
+        Image buffers[2];
+        for(uint32_t t = first; t < last; t++)
+        {
+            uint32_t left   = static_cast<uint64_t>(t % columns) * w / columns;
+            uint32_t right  = static_cast<uint64_t>(t % columns + 1) * w / columns;
+            uint32_t top    = static_cast<uint64_t>(t / columns) * h / rows;
+            uint32_t bottom = static_cast<uint64_t>(t / columns + 1) * h / rows;
+
+            /* region of the image held by current , it shrinks to the tile stage by stage */
+            uint32_t x = left > halo[0] ? left - halo[0] : 0;
+            uint32_t y = top > halo[0] ? top - halo[0] : 0;
+            uint32_t x1 = right + halo[0] < w ? right + halo[0] : w;
+            uint32_t y1 = bottom + halo[0] < h ? bottom + halo[0] : h;
+            Image current = view(src, x, y, x1 - x, y1 - y);
+
+            for(size_t k = begin; k < end; k++)
+            {
+                Image& output = buffers[(k - begin) & 1];
+                stages_[k].apply(current, output);
+
+                uint32_t margin = halo[k + 1 - begin];
+                uint32_t nx = left > margin ? left - margin : 0;
+                uint32_t ny = top > margin ? top - margin : 0;
+                uint32_t nx1 = right + margin < w ? right + margin : w;
+                uint32_t ny1 = bottom + margin < h ? bottom + margin : h;
+                current = view(output, nx - x, ny - y, nx1 - nx, ny1 - ny);
+                x = nx;
+                y = ny;
+            }
+
+            for(uint32_t row = top; row < bottom; row++)
+            {
+                memcpy(&dst[row][left], &current[row - top][0], sizeof(RgbPixel) * (right - left));
+            }
+        }
+    });
+}
+
+static Image view(const Image& src, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    return Image(width, height, const_cast<RgbPixel*>(&src[y][x]), src.step());
+}
+
+}; // namespace lolita
@@ -0,0 +1,56 @@
+/* Chain of operators which runs tile by tile */
+#ifndef LOLITA_PIPELINE_H
+#define LOLITA_PIPELINE_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "mat.hpp"
+
+namespace lolita
+{
+
+/*
+ * Operators are recorded and run later by run() , on tiles small enough to stay in cache ,
+ * every tile is read with a halo as wide as the sum of radii of the following operators ,
+ * so the result is the same as running them one by one on the whole image.
+ *
+ *     Pipeline p;
+ *     p.gray().gauss(2, 1.0).threshold().erode(1);
+ *     p.run(src, dst);
+ */
+class Pipeline
+{
+public:
+    Pipeline& gray();
+    Pipeline& threshold(uint8_t threshold = 0);
+    Pipeline& edge();
+    Pipeline& blur(uint32_t radius);
+    Pipeline& median(uint32_t radius);
+    Pipeline& gauss(uint32_t radius, double variance = 1);
+    Pipeline& erode(uint32_t radius);
+    Pipeline& dilate(uint32_t radius);
+
+    void clear();
+    size_t size() const;
+
+    /* src and dst can be the same image */
+    void run(const Image& src, Image& dst) const;
+
+private:
+    struct Stage
+    {
+        uint32_t radius;        // pixels of the source read around every pixel
+        bool global;            // reads the whole image , such as Kittler threshold , can't run on tiles
+        std::function<void(const Image&, Image&)> apply;
+    };
+
+    Pipeline& push(uint32_t radius, bool global, std::function<void(const Image&, Image&)> apply);
+    void runTiles(const Image& src, Image& dst, size_t begin, size_t end) const;
+
+    std::vector<Stage> stages_;
+};
+
+}; // namespace lolita
+
+#endif
@@ -40,10 +40,81 @@ public:
         int16_t value;
 };
 
+/* compact pixels , 1 byte per channel , channels are stored in order of BMP file */
+class Rgb24Pixel
+{
+public:
+
+    uint8_t blue;
+    uint8_t green;
+    uint8_t red;
+};
+
+
+class Rgba32Pixel
+{
+public:
+
+    uint8_t blue;
+    uint8_t green;
+    uint8_t red;
+    uint8_t alpha;
+};
+
 HsvPixel rgb2hsv(RgbPixel color);
 RgbPixel hsv2rgb(HsvPixel color);
 uintmax_t distance(HsvPixel p1, HsvPixel p2);
 
+inline uint8_t saturate(int32_t value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+/* 0.299 * red + 0.587 * green + 0.114 * blue , by fixed-point weights of 14 bits */
+inline int32_t luma(int32_t red, int32_t green, int32_t blue)
+{
+    return (red * 4899 + green * 9617 + blue * 1868 + 8192) >> 14;
+}
+
+inline uint8_t rgb2gray(RgbPixel color)
+{
+    return saturate(luma(color.red, color.green, color.blue));
+}
+
+inline RgbPixel gray2rgb(uint8_t gray)
+{
+    return RgbPixel::RGB(gray, gray, gray);
+}
+
+inline Rgb24Pixel pack24(RgbPixel color)
+{
+    Rgb24Pixel p;
+    p.blue  = saturate(color.blue);
+    p.green = saturate(color.green);
+    p.red   = saturate(color.red);
+    return p;
+}
+
+inline Rgba32Pixel pack32(RgbPixel color)
+{
+    Rgba32Pixel p;
+    p.blue  = saturate(color.blue);
+    p.green = saturate(color.green);
+    p.red   = saturate(color.red);
+    p.alpha = saturate(color.alpha);
+    return p;
+}
+
+inline RgbPixel unpack(Rgb24Pixel color)
+{
+    return RgbPixel::RGB(color.red, color.green, color.blue);
+}
+
+inline RgbPixel unpack(Rgba32Pixel color)
+{
+    return RgbPixel::RGB(color.red, color.green, color.blue, color.alpha);
+}
+
 template<typename T>
 T maximum(T arg1, T arg2)
 {
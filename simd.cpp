@@ -0,0 +1,526 @@
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LOLITA_X86 1
+#include <immintrin.h>
+#endif
+
+namespace lolita
+{
+
+/**[Private]***********************************************************************************************/
+struct Kernels
+{
+    void (*gray)(RgbPixel*, size_t);
+    void (*grayTo8)(const RgbPixel*, uint8_t*, size_t);
+    void (*threshold)(RgbPixel*, size_t, uint8_t);
+    void (*threshold8)(uint8_t*, size_t, uint8_t);
+    void (*bgr24)(const uint8_t*, RgbPixel*, size_t);
+    void (*bgra32)(const uint8_t*, RgbPixel*, size_t);
+    void (*rgb565)(const uint8_t*, RgbPixel*, size_t);
+    void (*packBgr24)(const RgbPixel*, uint8_t*, size_t);
+    void (*packBgra32)(const RgbPixel*, uint8_t*, size_t);
+};
+
+static Kernels& kernels();
+static Kernels select(Isa isa);
+
+
+/**[Scalar]************************************************************************************************/
+static void grayScalar(RgbPixel* pixels, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        pixels[i].red = pixels[i].green = pixels[i].blue = luma(pixels[i].red, pixels[i].green, pixels[i].blue);
+    }
+}
+
+static void grayTo8Scalar(const RgbPixel* src, uint8_t* dst, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        dst[i] = saturate(luma(src[i].red, src[i].green, src[i].blue));
+    }
+}
+
+static void thresholdScalar(RgbPixel* pixels, size_t n, uint8_t threshold)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        pixels[i].red = pixels[i].green = pixels[i].blue = (pixels[i].red >= threshold ? 0xff : 0);
+    }
+}
+
+static void threshold8Scalar(uint8_t* pixels, size_t n, uint8_t threshold)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        pixels[i] = (pixels[i] >= threshold ? 0xff : 0);
+    }
+}
+
+static void bgr24Scalar(const uint8_t* src, RgbPixel* dst, size_t n)
+{
+    for(size_t i = 0; i < n; i++, src += 3)
+    {
+        dst[i].red = src[2];
+        dst[i].green = src[1];
+        dst[i].blue = src[0];
+        dst[i].alpha = 0;
+    }
+}
+
+static void bgra32Scalar(const uint8_t* src, RgbPixel* dst, size_t n)
+{
+    for(size_t i = 0; i < n; i++, src += 4)
+    {
+        dst[i].red = src[2];
+        dst[i].green = src[1];
+        dst[i].blue = src[0];
+        dst[i].alpha = src[3];
+    }
+}
+
+static void rgb565Scalar(const uint8_t* src, RgbPixel* dst, size_t n)
+{
+    for(size_t i = 0; i < n; i++, src += 2)
+    {
+        uint16_t color = src[0] | (src[1] << 8);
+        dst[i].red = ((color & 0xf800) >> 11) << 3;
+        dst[i].green = ((color & 0x07e0) >> 5) << 2;
+        dst[i].blue = (color & 0x001f) << 3;
+        dst[i].alpha = 0;
+    }
+}
+
+static void packBgr24Scalar(const RgbPixel* src, uint8_t* dst, size_t n)
+{
+    for(size_t i = 0; i < n; i++, dst += 3)
+    {
+        dst[0] = src[i].blue;
+        dst[1] = src[i].green;
+        dst[2] = src[i].red;
+    }
+}
+
+static void packBgra32Scalar(const RgbPixel* src, uint8_t* dst, size_t n)
+{
+    for(size_t i = 0; i < n; i++, dst += 4)
+    {
+        dst[0] = src[i].blue;
+        dst[1] = src[i].green;
+        dst[2] = src[i].red;
+        dst[3] = src[i].alpha;
+    }
+}
+
+
+#ifdef LOLITA_X86
+/**[SSE2]**************************************************************************************************/
+/*
+ * A RgbPixel is 4 int16 : red green blue alpha , so a 128 bits register holds 2 pixels.
+ * madd by weights (wr, wg, wb, 0) gives (r*wr + g*wg , b*wb) for each pixel ,
+ * adding the two halves gives the same sum as luma() .
+ */
+__attribute__((target("sse2")))
+static inline __m128i lumaSse2(__m128i pixels)
+{
+    const __m128i weights = _mm_setr_epi16(4899, 9617, 1868, 0, 4899, 9617, 1868, 0);
+    const __m128i round = _mm_set1_epi32(8192);
+    __m128i sums = _mm_madd_epi16(pixels, weights);
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_srai_epi32(_mm_add_epi32(sums, round), 14);     // (y0, y0, y1, y1)
+}
+
+__attribute__((target("sse2")))
+static void graySse2(RgbPixel* pixels, size_t n)
+{
+    const __m128i alpha = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+    {
+        __m128i* p = reinterpret_cast<__m128i*>(pixels + i);
+        __m128i v = _mm_loadu_si128(p);
+        __m128i y = lumaSse2(v);
+        y = _mm_or_si128(_mm_and_si128(y, _mm_set1_epi32(0xffff)), _mm_slli_epi32(y, 16));
+        _mm_storeu_si128(p, _mm_or_si128(_mm_andnot_si128(alpha, y), _mm_and_si128(alpha, v)));
+    }
+    grayScalar(pixels + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void grayTo8Sse2(const RgbPixel* src, uint8_t* dst, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        const __m128i* p = reinterpret_cast<const __m128i*>(src + i);
+        __m128i y0 = _mm_shuffle_epi32(lumaSse2(_mm_loadu_si128(p + 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i y1 = _mm_shuffle_epi32(lumaSse2(_mm_loadu_si128(p + 1)), _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i y2 = _mm_shuffle_epi32(lumaSse2(_mm_loadu_si128(p + 2)), _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i y3 = _mm_shuffle_epi32(lumaSse2(_mm_loadu_si128(p + 3)), _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i lo = _mm_unpacklo_epi64(y0, y1);
+        __m128i hi = _mm_unpacklo_epi64(y2, y3);
+        __m128i words = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(words, words));
+    }
+    grayTo8Scalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void thresholdSse2(RgbPixel* pixels, size_t n, uint8_t threshold)
+{
+    const __m128i alpha = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+    const __m128i limit = _mm_set1_epi16(threshold - 1);
+    const __m128i white = _mm_set1_epi16(0xff);
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+    {
+        __m128i* p = reinterpret_cast<__m128i*>(pixels + i);
+        __m128i v = _mm_loadu_si128(p);
+        __m128i red = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0), 0);
+        __m128i bw = _mm_and_si128(_mm_cmpgt_epi16(red, limit), white);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_andnot_si128(alpha, bw), _mm_and_si128(alpha, v)));
+    }
+    thresholdScalar(pixels + i, n - i, threshold);
+}
+
+__attribute__((target("sse2")))
+static void threshold8Sse2(uint8_t* pixels, size_t n, uint8_t threshold)
+{
+    const __m128i limit = _mm_set1_epi8(threshold);
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16)
+    {
+        __m128i* p = reinterpret_cast<__m128i*>(pixels + i);
+        __m128i v = _mm_loadu_si128(p);
+        _mm_storeu_si128(p, _mm_cmpeq_epi8(_mm_max_epu8(v, limit), v));
+    }
+    threshold8Scalar(pixels + i, n - i, threshold);
+}
+
+/* without pshufb , 24 bits pixels are left to the scalar code */
+__attribute__((target("sse2")))
+static void bgra32Sse2(const uint8_t* src, RgbPixel* dst, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);       // b0 g0 r0 a0 b1 g1 r1 a1
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+        hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+        __m128i* p = reinterpret_cast<__m128i*>(dst + i);
+        _mm_storeu_si128(p + 0, lo);
+        _mm_storeu_si128(p + 1, hi);
+    }
+    bgra32Scalar(src + 4 * i, dst + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void rgb565Sse2(const uint8_t* src, RgbPixel* dst, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+        __m128i red = _mm_slli_epi16(_mm_srli_epi16(v, 11), 3);
+        __m128i green = _mm_slli_epi16(_mm_srli_epi16(_mm_slli_epi16(v, 5), 10), 2);
+        __m128i blue = _mm_slli_epi16(_mm_srli_epi16(_mm_slli_epi16(v, 11), 11), 3);
+        __m128i rg0 = _mm_unpacklo_epi16(red, green);
+        __m128i rg1 = _mm_unpackhi_epi16(red, green);
+        __m128i ba0 = _mm_unpacklo_epi16(blue, zero);
+        __m128i ba1 = _mm_unpackhi_epi16(blue, zero);
+        __m128i* p = reinterpret_cast<__m128i*>(dst + i);
+        _mm_storeu_si128(p + 0, _mm_unpacklo_epi32(rg0, ba0));
+        _mm_storeu_si128(p + 1, _mm_unpackhi_epi32(rg0, ba0));
+        _mm_storeu_si128(p + 2, _mm_unpacklo_epi32(rg1, ba1));
+        _mm_storeu_si128(p + 3, _mm_unpackhi_epi32(rg1, ba1));
+    }
+    rgb565Scalar(src + 2 * i, dst + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void packBgra32Sse2(const RgbPixel* src, uint8_t* dst, size_t n)
+{
+    const __m128i low = _mm_set1_epi16(0xff);
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        const __m128i* p = reinterpret_cast<const __m128i*>(src + i);
+        __m128i v0 = _mm_and_si128(_mm_loadu_si128(p + 0), low);
+        __m128i v1 = _mm_and_si128(_mm_loadu_si128(p + 1), low);
+        v0 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v0, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+        v1 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v1, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i), _mm_packus_epi16(v0, v1));
+    }
+    packBgra32Scalar(src + i, dst + 4 * i, n - i);
+}
+
+
+/**[AVX2]**************************************************************************************************/
+__attribute__((target("avx2")))
+static inline __m256i lumaAvx2(__m256i pixels)
+{
+    const __m256i weights = _mm256_setr_epi16(4899, 9617, 1868, 0, 4899, 9617, 1868, 0,
+                                              4899, 9617, 1868, 0, 4899, 9617, 1868, 0);
+    const __m256i round = _mm256_set1_epi32(8192);
+    __m256i sums = _mm256_madd_epi16(pixels, weights);
+    sums = _mm256_add_epi32(sums, _mm256_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm256_srai_epi32(_mm256_add_epi32(sums, round), 14);
+}
+
+__attribute__((target("avx2")))
+static void grayAvx2(RgbPixel* pixels, size_t n)
+{
+    const __m256i alpha = _mm256_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1);
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256i* p = reinterpret_cast<__m256i*>(pixels + i);
+        __m256i v = _mm256_loadu_si256(p);
+        __m256i y = lumaAvx2(v);
+        y = _mm256_or_si256(_mm256_and_si256(y, _mm256_set1_epi32(0xffff)), _mm256_slli_epi32(y, 16));
+        _mm256_storeu_si256(p, _mm256_blendv_epi8(y, v, alpha));
+    }
+    graySse2(pixels + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void grayTo8Avx2(const RgbPixel* src, uint8_t* dst, size_t n)
+{
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16)
+    {
+        const __m256i* p = reinterpret_cast<const __m256i*>(src + i);
+        /* (y0 y0 y1 y1 | y2 y2 y3 y3) -> (y0 y1 y2 y3) in the low 128 bits */
+        const __m256i order = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+        __m256i y0 = _mm256_permutevar8x32_epi32(lumaAvx2(_mm256_loadu_si256(p + 0)), order);
+        __m256i y1 = _mm256_permutevar8x32_epi32(lumaAvx2(_mm256_loadu_si256(p + 1)), order);
+        __m256i y2 = _mm256_permutevar8x32_epi32(lumaAvx2(_mm256_loadu_si256(p + 2)), order);
+        __m256i y3 = _mm256_permutevar8x32_epi32(lumaAvx2(_mm256_loadu_si256(p + 3)), order);
+        __m128i lo = _mm_packs_epi32(_mm256_castsi256_si128(y0), _mm256_castsi256_si128(y1));
+        __m128i hi = _mm_packs_epi32(_mm256_castsi256_si128(y2), _mm256_castsi256_si128(y3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    grayTo8Sse2(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void thresholdAvx2(RgbPixel* pixels, size_t n, uint8_t threshold)
+{
+    const __m256i alpha = _mm256_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1);
+    const __m256i limit = _mm256_set1_epi16(threshold - 1);
+    const __m256i white = _mm256_set1_epi16(0xff);
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256i* p = reinterpret_cast<__m256i*>(pixels + i);
+        __m256i v = _mm256_loadu_si256(p);
+        __m256i red = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, 0), 0);
+        __m256i bw = _mm256_and_si256(_mm256_cmpgt_epi16(red, limit), white);
+        _mm256_storeu_si256(p, _mm256_blendv_epi8(bw, v, alpha));
+    }
+    thresholdSse2(pixels + i, n - i, threshold);
+}
+
+__attribute__((target("avx2")))
+static void threshold8Avx2(uint8_t* pixels, size_t n, uint8_t threshold)
+{
+    const __m256i limit = _mm256_set1_epi8(threshold);
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32)
+    {
+        __m256i* p = reinterpret_cast<__m256i*>(pixels + i);
+        __m256i v = _mm256_loadu_si256(p);
+        _mm256_storeu_si256(p, _mm256_cmpeq_epi8(_mm256_max_epu8(v, limit), v));
+    }
+    threshold8Sse2(pixels + i, n - i, threshold);
+}
+
+/* pshufb puts 4 pixels in the order of RgbPixel , vpmovzxbw widens them to 16 bits */
+__attribute__((target("avx2")))
+static void bgr24Avx2(const uint8_t* src, RgbPixel* dst, size_t n)
+{
+    const __m128i order = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    size_t i = 0;
+
+    /* 16 bytes are loaded for 12 bytes of pixels , keep the load inside the row */
+    for(; i + 6 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_cvtepu8_epi16(_mm_shuffle_epi8(v, order)));
+    }
+    bgr24Scalar(src + 3 * i, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void bgra32Avx2(const uint8_t* src, RgbPixel* dst, size_t n)
+{
+    const __m128i order = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_cvtepu8_epi16(_mm_shuffle_epi8(v, order)));
+    }
+    bgra32Scalar(src + 4 * i, dst + i, n - i);
+}
+
+/* low bytes of blue , green and red of 2 pixels in a register , by pshufb */
+__attribute__((target("avx2")))
+static void packBgr24Avx2(const RgbPixel* src, uint8_t* dst, size_t n)
+{
+    const __m128i order0 = _mm_setr_epi8(4, 2, 0, 12, 10, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i order1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 4, 2, 0, 12, 10, 8, -1, -1, -1, -1);
+    size_t i = 0;
+
+    /* 16 bytes are stored for 12 bytes of pixels , keep the store inside the row */
+    for(; i + 6 <= n; i += 4)
+    {
+        const __m128i* p = reinterpret_cast<const __m128i*>(src + i);
+        __m128i v0 = _mm_shuffle_epi8(_mm_loadu_si128(p + 0), order0);
+        __m128i v1 = _mm_shuffle_epi8(_mm_loadu_si128(p + 1), order1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * i), _mm_or_si128(v0, v1));
+    }
+    packBgr24Scalar(src + i, dst + 3 * i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void packBgra32Avx2(const RgbPixel* src, uint8_t* dst, size_t n)
+{
+    const __m256i low = _mm256_set1_epi16(0xff);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        const __m256i* p = reinterpret_cast<const __m256i*>(src + i);
+        __m256i v0 = _mm256_and_si256(_mm256_loadu_si256(p + 0), low);
+        __m256i v1 = _mm256_and_si256(_mm256_loadu_si256(p + 1), low);
+        v0 = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v0, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+        v1 = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v1, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+
+        /* packus works in 128 bits lanes , put pixels back in order */
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * i), packed);
+    }
+    packBgra32Sse2(src + i, dst + 4 * i, n - i);
+}
+#endif // LOLITA_X86
+
+
+/**********************************************************************************************************/
+Isa cpuIsa()
+{
+#ifdef LOLITA_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return Isa::Avx2;
+    }
+    if(__builtin_cpu_supports("sse2"))
+    {
+        return Isa::Sse2;
+    }
+#endif
+    return Isa::Scalar;
+}
+
+static Isa& isa()
+{
+    static Isa current = cpuIsa();
+    return current;
+}
+
+Isa currentIsa()
+{
+    return isa();
+}
+
+void useIsa(Isa level)
+{
+    /* never use what the CPU doesn't support */
+    isa() = level < cpuIsa() ? level : cpuIsa();
+    kernels() = select(isa());
+}
+
+void grayPixels(RgbPixel* pixels, size_t n)
+{
+    kernels().gray(pixels, n);
+}
+
+void grayPixels(const RgbPixel* src, uint8_t* dst, size_t n)
+{
+    kernels().grayTo8(src, dst, n);
+}
+
+void thresholdPixels(RgbPixel* pixels, size_t n, uint8_t threshold)
+{
+    kernels().threshold(pixels, n, threshold);
+}
+
+void thresholdPixels(uint8_t* pixels, size_t n, uint8_t threshold)
+{
+    kernels().threshold8(pixels, n, threshold);
+}
+
+void expandBgr24(const uint8_t* src, RgbPixel* dst, size_t n)
+{
+    kernels().bgr24(src, dst, n);
+}
+
+void expandBgra32(const uint8_t* src, RgbPixel* dst, size_t n)
+{
+    kernels().bgra32(src, dst, n);
+}
+
+void expandRgb565(const uint8_t* src, RgbPixel* dst, size_t n)
+{
+    kernels().rgb565(src, dst, n);
+}
+
+void packBgr24(const RgbPixel* src, uint8_t* dst, size_t n)
+{
+    kernels().packBgr24(src, dst, n);
+}
+
+void packBgra32(const RgbPixel* src, uint8_t* dst, size_t n)
+{
+    kernels().packBgra32(src, dst, n);
+}
+
+
+/**[Private]***********************************************************************************************/
+static Kernels& kernels()
+{
+    static Kernels current = select(isa());
+    return current;
+}
+
+static Kernels select(Isa level)
+{
+    Kernels k = {grayScalar, grayTo8Scalar, thresholdScalar, threshold8Scalar,
+                 bgr24Scalar, bgra32Scalar, rgb565Scalar,
+                 packBgr24Scalar, packBgra32Scalar};
+#ifdef LOLITA_X86
+    if(level == Isa::Avx2)
+    {
+        k = {grayAvx2, grayTo8Avx2, thresholdAvx2, threshold8Avx2,
+             bgr24Avx2, bgra32Avx2, rgb565Sse2,
+             packBgr24Avx2, packBgra32Avx2};
+    }
+    else if(level == Isa::Sse2)
+    {
+        k = {graySse2, grayTo8Sse2, thresholdSse2, threshold8Sse2,
+             bgr24Scalar, bgra32Sse2, rgb565Sse2,
+             packBgr24Scalar, packBgra32Sse2};
+    }
+#else
+    (void)level;
+#endif
+    return k;
+}
+
+}; // namespace lolita
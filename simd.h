@@ -0,0 +1,49 @@
+/* SIMD kernels of point operations , selected at runtime by CPU features */
+#ifndef LOLITA_SIMD_H
+#define LOLITA_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+#include "pixel.h"
+
+namespace lolita
+{
+
+enum class Isa
+{
+    Scalar,
+    Sse2,
+    Avx2,
+};
+
+/* best instruction set supported by this CPU */
+Isa cpuIsa();
+
+/* instruction set in use , it's cpuIsa() by default , lower it to test other paths */
+Isa currentIsa();
+void useIsa(Isa isa);
+
+/* pixels[i].red = green = blue = luma , alpha is kept */
+void grayPixels(RgbPixel* pixels, size_t n);
+
+/* dst[i] = luma of src[i] , saturated into [0, 255] */
+void grayPixels(const RgbPixel* src, uint8_t* dst, size_t n);
+
+/* pixels[i].red = green = blue = (red >= threshold ? 255 : 0) , alpha is kept */
+void thresholdPixels(RgbPixel* pixels, size_t n, uint8_t threshold);
+
+/* pixels[i] = (pixels[i] >= threshold ? 255 : 0) */
+void thresholdPixels(uint8_t* pixels, size_t n, uint8_t threshold);
+
+/* expand n pixels of a BMP scanline into RgbPixel , alpha is 0 unless the source has it */
+void expandBgr24(const uint8_t* src, RgbPixel* dst, size_t n);
+void expandBgra32(const uint8_t* src, RgbPixel* dst, size_t n);
+void expandRgb565(const uint8_t* src, RgbPixel* dst, size_t n);
+
+/* pack n RgbPixel into a BMP scanline , channels are truncated to 8 bits */
+void packBgr24(const RgbPixel* src, uint8_t* dst, size_t n);
+void packBgra32(const RgbPixel* src, uint8_t* dst, size_t n);
+
+}; // namespace lolita
+
+#endif
@@ -1,4 +1,8 @@
 #include "tools.h"
+#include "simd.h"
+#include "parallel.h"
+#include "fft.h"
+#include <atomic>
 #include <cmath>
 #include <functional>
 #include <vector>
@@ -8,10 +12,145 @@ namespace lolita
 
 
 /**[Private]***********************************************************************************************/
-static RgbPixel convolutionElement(Image& mat, uint32_t row, uint32_t column, Mat<double>& kernel);
-static RgbPixel traverse(Image& mat, uint32_t row, uint32_t column, uint32_t radius, std::function<RgbPixel(std::vector<RgbPixel>&)> callback);
+/* access channels of different pixels by index , so that filters can work on all of them */
+template<typename Pixel>
+struct Channels;
+
+template<>
+struct Channels<RgbPixel>
+{
+    static const int count = 3;
+
+    static int16_t get(const RgbPixel& pix, int channel)
+    {
+        return channel == 0 ? pix.red : channel == 1 ? pix.green : pix.blue;
+    }
+
+    static void set(RgbPixel& pix, int channel, int16_t value)
+    {
+        (channel == 0 ? pix.red : channel == 1 ? pix.green : pix.blue) = value;
+    }
+
+    /* filters don't touch alpha , copy it when writing to another image */
+    static void rest(RgbPixel& pix, const RgbPixel& src)
+    {
+        pix.alpha = src.alpha;
+    }
+};
+
+template<>
+struct Channels<uint8_t>
+{
+    static const int count = 1;
+
+    static int16_t get(const uint8_t& pix, int)
+    {
+        return pix;
+    }
+
+    static void set(uint8_t& pix, int, int16_t value)
+    {
+        pix = saturate(value);
+    }
+
+    static void rest(uint8_t&, const uint8_t&)
+    {
+
+    }
+};
+
+template<>
+struct Channels<Rgb24Pixel>
+{
+    static const int count = 3;
+
+    static int16_t get(const Rgb24Pixel& pix, int channel)
+    {
+        return channel == 0 ? pix.red : channel == 1 ? pix.green : pix.blue;
+    }
+
+    static void set(Rgb24Pixel& pix, int channel, int16_t value)
+    {
+        (channel == 0 ? pix.red : channel == 1 ? pix.green : pix.blue) = saturate(value);
+    }
+
+    static void rest(Rgb24Pixel&, const Rgb24Pixel&)
+    {
+
+    }
+};
+
+template<>
+struct Channels<Rgba32Pixel>
+{
+    static const int count = 3;
+
+    static int16_t get(const Rgba32Pixel& pix, int channel)
+    {
+        return channel == 0 ? pix.red : channel == 1 ? pix.green : pix.blue;
+    }
+
+    static void set(Rgba32Pixel& pix, int channel, int16_t value)
+    {
+        (channel == 0 ? pix.red : channel == 1 ? pix.green : pix.blue) = saturate(value);
+    }
+
+    /* filters don't touch alpha , copy it when writing to another image */
+    static void rest(Rgba32Pixel& pix, const Rgba32Pixel& src)
+    {
+        pix.alpha = src.alpha;
+    }
+};
+
+template<typename Pixel>
+static uint8_t kittler(const Mat<Pixel>& mat);
+template<typename Pixel>
+static void binarize(const Mat<Pixel>& src, Mat<Pixel>& dst, uint8_t threshold);
+template<typename Pixel>
+static bool convolve(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<double>& kernel);
+template<typename Pixel>
+static bool sepConvolve(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<double>& rowKernel, const Mat<double>& colKernel);
+template<typename Pixel>
+static void fftConvolve(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<double>& kernel, uint32_t tileWidth, uint32_t tileHeight);
+static uint32_t fftTile(uint32_t size, uint32_t side);
+static bool fftPays(uint32_t side, uint32_t tileWidth, uint32_t tileHeight);
+template<typename Pixel>
+static void boxBlur(const Mat<Pixel>& src, Mat<Pixel>& dst, uint32_t radius);
+template<typename Pixel>
+static void rankBlur(const Mat<Pixel>& src, Mat<Pixel>& dst, uint32_t radius, double percentile);
+template<typename Pixel>
+static void rankStrip(const Mat<Pixel>& src, Mat<Pixel>& dst, int channel, uint32_t radius, double percentile, uint32_t begin, uint32_t end, uint32_t top, uint32_t bottom);
+template<typename Pixel, typename Operator>
+static void morphology(const Mat<Pixel>& src, Mat<Pixel>& dst, uint32_t radiusX, uint32_t radiusY, int16_t identity, Operator op);
+template<typename Pixel>
+static void gradient(const Mat<Pixel>& src, Mat<Pixel>& dst, uint32_t radius);
+template<typename Pixel>
+static Pixel convolutionElement(const Mat<Pixel>& mat, uint32_t row, uint32_t column, const Mat<double>& kernel);
+template<typename Pixel>
+static void bilinear(const Mat<Pixel>& src, Mat<Pixel>& dst, uint32_t width, uint32_t height);
+template<typename Pixel>
+static void grayPacked(const Mat<Pixel>& src, GrayImage& dst);
+template<typename Pixel>
+static Mat<Pixel> source(Mat<Pixel>& mat);
+template<typename Pixel>
+static void prepare(Mat<Pixel>& dst, uint32_t width, uint32_t height);
+static bool separate(const Mat<double>& kernel, Mat<double>& rowKernel, Mat<double>& colKernel);
+static void edgeKernel(Mat<double>& kernel);
+static void gaussianVectors(Mat<double>& rowKernel, Mat<double>& colKernel, uint32_t radius, double variance);
+struct Minimum16{ int16_t operator()(int16_t a, int16_t b) const { return a < b ? a : b; } };
+struct Maximum16{ int16_t operator()(int16_t a, int16_t b) const { return a > b ? a : b; } };
 static double bicubicCoefficient(double offset);
 
+/* multiplications of the direct convolution as costly as a point of FFT times log2 of the size , measured */
+static const double fftCost = 3;
+
+/*
+ * sums of convolutions are truncated , but round-off of each way differs , about 1e-12 by FFT ,
+ * so an exact integer may come out as 44.999... ; all ways add this bias before truncating ,
+ * then direct , separable and FFT convolutions give the same result
+ */
+static const double roundOffBias = 1e-7;
+
 /******************************************************************************************
  * Name       : grayScale
  * 
@@ -25,9 +164,69 @@ static double bicubicCoefficient(double offset);
  ******************************************************************************************/
 void grayScale(Image& mat)
 {
-    mat.map([](RgbPixel& pix)
+    grayScale(mat, mat);
+}
+
+
+
+/******************************************************************************************
+ * Name       : grayScale
+ * 
+ * Input      : src - source image
+ * 
+ * Output     : dst - gray-scale image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : Convert a image to gray-scale image , write the result into dst
+ ******************************************************************************************/
+void grayScale(const Image& src, Image& dst)
+{
+    if(&src == &dst)
+    {
+        dst.detach();
+    }
+    else
+    {
+        prepare(dst, src.width(), src.height());
+    }
+
+    parallelFor(0, src.height(), 16, [&](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t y = begin; y < end; y++)
+        {
+            if(&src != &dst)
+            {
+                memcpy(&dst[y][0], &src[y][0], sizeof(RgbPixel) * src.width());
+            }
+            grayPixels(&dst[y][0], src.width());
+        }
+    });
+}
+
+
+
+/******************************************************************************************
+ * Name       : grayScale
+ * 
+ * Input      : src - source image
+ * 
+ * Output     : dst - gray-scale image , 1 byte per pixel
+ * 
+ * Return     : void
+ * 
+ * Function   : Convert a image to compact gray-scale image
+ ******************************************************************************************/
+void grayScale(const Image& src, GrayImage& dst)
+{
+    prepare(dst, src.width(), src.height());
+    parallelFor(0, src.height(), 16, [&](uint32_t begin, uint32_t end)
     {
-        pix.red = pix.green = pix.blue = pix.red*0.299 + pix.green*0.587 + pix.blue*0.114;
+        for(uint32_t y = begin; y < end; y++)
+        {
+            grayPixels(&src[y][0], &dst[y][0], src.width());
+        }
     });
 }
 
@@ -51,28 +250,31 @@ void grayScale(Image& mat)
  ******************************************************************************************/
 void binaryzation(Image& mat, uint8_t threshold)
 {
-    if(threshold == 0)
-    {
-        // Kittler
-        uintmax_t sumGrads = 0;
-        uintmax_t sumGrayGrads = 0;
-        for(uint32_t i = 1; i < mat.height()-1; i++)
-        {
-            for(uint32_t j = 1; j < mat.width()-1; j++)
-            {
-                uint8_t grads = std::max(std::abs(mat[i][j-1].red - mat[i][j+1].red) , std::abs(mat[i-1][j].red - mat[i+1][j].red));
-                sumGrads += grads;
-                sumGrayGrads += grads * mat[i][j].red;
-            }
-        }
+    binaryzation(mat, mat, threshold);
+}
 
-        threshold = sumGrayGrads / sumGrads;
-    }
 
-    mat.map([threshold](RgbPixel& pix)
-    {
-        pix.red = pix.green = pix.blue = (pix.red >= threshold ? 0xff : 0);
-    });
+
+/******************************************************************************************
+ * Name       : binaryzation
+ * 
+ * Input      : src - source gray-scale image
+ * 
+ *              threshold - Rgbpixel in range of [threshold, 255] will be set as 255
+ *                          Rgbpixel in range of [0, threshold)  will be set as 0
+ *                          if threshold is 0 , this function will calculate a threshold by 
+ *                          Kittler Algorithm
+ * 
+ * Output     : dst - binaryzation image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : Convert a gray-scale image to binaryzation image , write the result into dst
+ ******************************************************************************************/
+void binaryzation(const Image& src, Image& dst, uint8_t threshold)
+{
+    binarize(src, dst, threshold);
 }
 
 
@@ -87,140 +289,123 @@ void binaryzation(Image& mat, uint8_t threshold)
  * 
  * Return     : bool
  * 
- * Function   : mat convolute kernel
+ * Function   : mat convolute kernel , large kernels run by FFT
  ******************************************************************************************/
 bool convolution(Image& mat, Mat<double>& kernel)
 {
-    if( kernel.width() != kernel.height() ||    // not a square
-        (kernel.width() & 1) != 1 ||              // length of side is not a odd number
-        kernel.width() > mat.width() ||         // kernel is bigger than mat
-        kernel.width() > mat.height())
-    {
-        return false;
-    }
-
-    Image backup = mat;
+    return convolution(mat, mat, kernel);
+}
 
-    for(uint32_t x = 0; x < mat.width(); x++)
-    {
-        for(uint32_t y = 0; y < mat.height(); y++)
-        {
-            mat[y][x] = convolutionElement(backup, y, x, kernel);
-        }
-    }
 
-    return true;
-}
 
 /******************************************************************************************
- * Name       : detectEdge
+ * Name       : convolution
  * 
- * Input      : mat - source image
+ * Input      : src - source image
  * 
- * Output     : mat - treated image
+ *              kernel - a real matrix 
  * 
- * Return     : void
+ * Output     : dst - convoluted image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
  * 
- * Function   : edge detector
+ * Return     : bool
+ * 
+ * Function   : mat convolute kernel , write the result into dst , large kernels run by FFT
  ******************************************************************************************/
-void detectEdge(Image& mat)
+bool convolution(const Image& src, Image& dst, Mat<double>& kernel)
 {
-    Mat<double> kernel(3,3);
-    kernel.map([](double& element){element = 1;});
-    kernel[1][1] = -8;
-
-    convolution(mat, kernel);
+    return convolve(src, dst, kernel);
 }
 
 
 
 /******************************************************************************************
- * Name       : averageBlur
+ * Name       : sepConvolution
  * 
  * Input      : mat - source image
  * 
- *              radius - radius of convolution kernel
+ *              rowKernel - a real matrix of 1 row , applied horizontally
  * 
- * Output     : mat - treated image
+ *              colKernel - a real matrix of 1 column , applied vertically
  * 
- * Return     : void
+ * Output     : mat - convoluted image
  * 
- * Function   : blur image by average
+ * Return     : bool
+ * 
+ * Function   : mat convolute the kernel colKernel * rowKernel by two 1-D passes
  ******************************************************************************************/
-void averageBlur(Image& mat, uint32_t radius)
+bool sepConvolution(Image& mat, Mat<double>& rowKernel, Mat<double>& colKernel)
 {
-    Mat<double> kernel(2*radius + 1, 2*radius + 1);
-    kernel.map([radius](double& pix){pix = 1.0/(2*radius + 1)/(2*radius + 1);});
-    convolution(mat, kernel);
+    return sepConvolution(mat, mat, rowKernel, colKernel);
 }
 
 
 
 /******************************************************************************************
- * Name       : medianBlur
+ * Name       : sepConvolution
  * 
- * Input      : mat - source image
+ * Input      : src - source image
  * 
- *              radius - radius of convolution kernel
+ *              rowKernel - a real matrix of 1 row , applied horizontally
+ * 
+ *              colKernel - a real matrix of 1 column , applied vertically
+ * 
+ * Output     : dst - convoluted image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : bool
+ * 
+ * Function   : mat convolute the kernel colKernel * rowKernel by two 1-D passes , write the result into dst
+ ******************************************************************************************/
+bool sepConvolution(const Image& src, Image& dst, Mat<double>& rowKernel, Mat<double>& colKernel)
+{
+    return sepConvolve(src, dst, rowKernel, colKernel);
+}
+
+/******************************************************************************************
+ * Name       : detectEdge
+ * 
+ * Input      : mat - source image
  * 
  * Output     : mat - treated image
  * 
  * Return     : void
  * 
- * Function   : blur image by median value
+ * Function   : edge detector
  ******************************************************************************************/
-void medianBlur(Image& mat, uint32_t radius)
+void detectEdge(Image& mat)
 {
-    Image backup = mat;
-    for(uint32_t y = 0 ; y < mat.height(); y++)
-    {
-        for(uint32_t x = 0; x < mat.width(); x++)
-        {
-            mat[y][x] = traverse(backup, y, x, radius,
-                            [](std::vector<RgbPixel>& Rgbpixels)->RgbPixel
-                            {
-                                std::sort(Rgbpixels.begin(), Rgbpixels.end());
-                                return Rgbpixels[Rgbpixels.size()/2];
-                            });
-        }
-    }
+    detectEdge(mat, mat);
 }
 
 
 
 /******************************************************************************************
- * Name       : erode
- * 
- * Input      : mat - source image
+ * Name       : detectEdge
  * 
- *              radius - radius of convolution kernel
+ * Input      : src - source image
  * 
- * Output     : mat - treated image
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
  * 
  * Return     : void
  * 
- * Function   : erode image by minimum value of area
+ * Function   : edge detector , write the result into dst
  ******************************************************************************************/
-void erode(Image& mat, uint32_t radius)
+void detectEdge(const Image& src, Image& dst)
 {
-    Image backup = mat;
-    for(uint32_t y = 0 ; y < mat.height(); y++)
+    Mat<double> kernel;
+    edgeKernel(kernel);
+    if(!convolve(src, dst, kernel))     // image is smaller than kernel
     {
-        for(uint32_t x = 0; x < mat.width(); x++)
-        {
-            mat[y][x] = traverse(backup, y, x, radius,
-                            [](std::vector<RgbPixel>& Rgbpixels)->RgbPixel
-                            {
-                                return *std::min_element(Rgbpixels.begin(), Rgbpixels.end());
-                            });
-        }
+        dst = src;
     }
 }
 
 
 
 /******************************************************************************************
- * Name       : dilate
+ * Name       : averageBlur
  * 
  * Input      : mat - source image
  * 
@@ -230,218 +415,1513 @@ void erode(Image& mat, uint32_t radius)
  * 
  * Return     : void
  * 
- * Function   : dilate image by maximum value of area
+ * Function   : blur image by average
  ******************************************************************************************/
-void dilate(Image& mat, uint32_t radius)
+void averageBlur(Image& mat, uint32_t radius)
 {
-    Image backup = mat;
-    for(uint32_t y = 0 ; y < mat.height(); y++)
-    {
-        for(uint32_t x = 0; x < mat.width(); x++)
-        {
-            mat[y][x] = traverse(backup, y, x, radius,
-                            [](std::vector<RgbPixel>& Rgbpixels)->RgbPixel
-                            {
-                                return *std::max_element(Rgbpixels.begin(), Rgbpixels.end());
-                            });
-        }
-    }
+    averageBlur(mat, mat, radius);
 }
 
 
 
-
-
 /******************************************************************************************
- * Name       : gaussian
+ * Name       : averageBlur
  * 
- * Input      : mat - empty matrix
+ * Input      : src - source image
  * 
  *              radius - radius of convolution kernel
  * 
- *              variance - sigma of Gaussian distribution
- * 
- * Output     : mat - Gaussian distribution Matrix
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
  * 
  * Return     : void
  * 
- * Function   : 1 / (2 * pi * variance * variance)  *  exp(- (x * x + y * y) / (2 * variance * variance))
+ * Function   : blur image by average , write the result into dst
  ******************************************************************************************/
-void gaussian(Mat<double>& mat, uint32_t radius, double variance)
+void averageBlur(const Image& src, Image& dst, uint32_t radius)
 {
-    double K = 1.0 / 2 / 3.1415926 / variance / variance;
-    mat.resize(2*radius + 1, 2*radius + 1);
-    for(int64_t y = -(int64_t)radius; y <= radius; y++)
-    {
-        for(int64_t x = -(int64_t)radius; x <= radius; x++)
-        {
-            mat[radius + y][radius + x] = K * exp( - ((double)(x)*x + y*y) / (2*variance*variance));
-        }
-    }
-
-    double sum = mat.reduce<double>([](double& element){return element;});
-    mat.map([sum](double& element){element /= sum;});
+    boxBlur(src, dst, radius);
 }
 
 
 
 /******************************************************************************************
- * Name       : gaussianBlur
+ * Name       : rankFilter
  * 
  * Input      : mat - source image
  * 
  *              radius - radius of convolution kernel
  * 
- *              variance - sigma of Gaussian distribution
+ *              percentile - rank of the chosen value in the area , in range of [0, 100]
+ *                           0 is the minimum , 50 is the median , 100 is the maximum
  * 
  * Output     : mat - treated image
  * 
  * Return     : void
  * 
- * Function   : blur image by Gaussian distribution
+ * Function   : set every channel by the value of given percentile in the area
  ******************************************************************************************/
-void gaussianBlur(Image& mat, uint32_t radius, double variance)
+void rankFilter(Image& mat, uint32_t radius, double percentile)
 {
-    Mat<double> kernel;
-    gaussian(kernel, radius, variance);
-    convolution(mat, kernel);
+    rankFilter(mat, mat, radius, percentile);
 }
 
 
 
 /******************************************************************************************
- * Name       : resize
+ * Name       : rankFilter
  * 
- * Input      : mat - source image
+ * Input      : src - source image
  * 
- *              width - width of new image
+ *              radius - radius of convolution kernel
  * 
- *              height - height of new image
+ *              percentile - rank of the chosen value in the area , in range of [0, 100]
+ *                           0 is the minimum , 50 is the median , 100 is the maximum
  * 
- * Output     : mat - treated image
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
  * 
  * Return     : void
  * 
- * Function   : resize a image
+ * Function   : set every channel by the value of given percentile in the area , write the result into dst
  ******************************************************************************************/
-void resize(Image& mat, uint32_t width, uint32_t height)
+void rankFilter(const Image& src, Image& dst, uint32_t radius, double percentile)
 {
-    Image temp = mat;
-    mat.resize(width, height);
-    double kx = static_cast<double>(temp.width()) / mat.width();
-    double ky = static_cast<double>(temp.height()) / mat.height();
-
-    for(uint32_t y = 0; y < mat.height(); y++)
-    {
-        for(uint32_t x = 0; x < mat.width(); x++)
-        {
-            double x_real = x * kx;
-            double y_real = y * ky;
-
-            uint32_t x_src = (uint32_t)x_real;
-            uint32_t y_src = (uint32_t)y_real;
-
-            double x_offset = x_real - x_src;
-            double y_offset = y_real - y_src;
-
-            int x_another = x_src + 1 < temp.width() ? x_src + 1 : x_src - 1;
-            int y_another = y_src + 1 < temp.height() ? y_src + 1 : y_src - 1;
-
-            mat[y][x].red =   y_offset * x_offset * temp[y_src][x_src].red 
-                            + (1 - y_offset) * x_offset * temp[y_another][x_src].red
-                            + y_offset * (1 - x_offset) * temp[y_src][x_another].red
-                            + (1 - y_offset) * (1 - x_offset) *temp[y_another][x_another].red;
-
-            mat[y][x].green =   y_offset * x_offset * temp[y_src][x_src].green 
-                            + (1 - y_offset) * x_offset * temp[y_another][x_src].green
-                            + y_offset * (1 - x_offset) * temp[y_src][x_another].green
-                            + (1 - y_offset) * (1 - x_offset) *temp[y_another][x_another].green;
-
-            mat[y][x].blue =   y_offset * x_offset * temp[y_src][x_src].blue 
-                            + (1 - y_offset) * x_offset * temp[y_another][x_src].blue
-                            + y_offset * (1 - x_offset) * temp[y_src][x_another].blue
-                            + (1 - y_offset) * (1 - x_offset) *temp[y_another][x_another].blue;
-        }
-    }
+    rankBlur(src, dst, radius, percentile);
 }
 
 
 
 /******************************************************************************************
- * Name       : resize
+ * Name       : medianBlur
  * 
  * Input      : mat - source image
  * 
- *              width - width of new image
- * 
- *              height - height of new image
+ *              radius - radius of convolution kernel
  * 
  * Output     : mat - treated image
  * 
  * Return     : void
  * 
- * Function   : resize a image by bicubic interpolation
+ * Function   : blur image by median value
  ******************************************************************************************/
-void bicubic(Image& mat, uint32_t width, uint32_t height)
+void medianBlur(Image& mat, uint32_t radius)
 {
-    Image temp = mat;
-    mat.resize(width, height);
-    double kx = static_cast<double>(temp.width()) / mat.width();
-    double ky = static_cast<double>(temp.height()) / mat.height();
-
-    for(uint32_t y = 0; y < mat.height(); y++)
-    {
-        for(uint32_t x = 0; x < mat.width(); x++)
-        {
-            double x_real = x * kx;
-            double y_real = y * ky;
-
-
-            /* find the 16 nearest Rgbpixel */
-            uint32_t x_begin, x_end;
-            uint32_t y_begin, y_end;
+    medianBlur(mat, mat, radius);
+}
 
-            x_begin = x_real - 1 > 0 ? x_real - 1 : 0;
-            x_end   = x_real + 3 < temp.width() ? x_real + 3 : temp.width();
 
-            y_begin = y_real - 1 > 0 ? y_real - 1 : 0;
-            y_end   = y_real + 3 < temp.height() ? y_real + 3 : temp.height();
 
-            mat[y][x] = 0;
-            for(uint32_t i = y_begin; i < y_end; i++)
+/******************************************************************************************
+ * Name       : medianBlur
+ * 
+ * Input      : src - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : blur image by median value , write the result into dst
+ ******************************************************************************************/
+void medianBlur(const Image& src, Image& dst, uint32_t radius)
+{
+    rankBlur(src, dst, radius, 50);
+}
+
+
+
+/******************************************************************************************
+ * Name       : erode
+ * 
+ * Input      : mat - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ * Output     : mat - treated image
+ * 
+ * Return     : void
+ * 
+ * Function   : erode image by minimum value of area
+ ******************************************************************************************/
+void erode(Image& mat, uint32_t radius)
+{
+    erode(mat, mat, radius, radius);
+}
+
+
+
+/******************************************************************************************
+ * Name       : erode
+ * 
+ * Input      : src - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : erode image by minimum value of area , write the result into dst
+ ******************************************************************************************/
+void erode(const Image& src, Image& dst, uint32_t radius)
+{
+    erode(src, dst, radius, radius);
+}
+
+
+
+/******************************************************************************************
+ * Name       : erode
+ * 
+ * Input      : mat - source image
+ * 
+ *              radiusX - horizontal radius of rectangular area
+ * 
+ *              radiusY - vertical radius of rectangular area
+ * 
+ * Output     : mat - treated image
+ * 
+ * Return     : void
+ * 
+ * Function   : erode image by minimum value of each channel in a rectangular area
+ ******************************************************************************************/
+void erode(Image& mat, uint32_t radiusX, uint32_t radiusY)
+{
+    erode(mat, mat, radiusX, radiusY);
+}
+
+
+
+/******************************************************************************************
+ * Name       : erode
+ * 
+ * Input      : src - source image
+ * 
+ *              radiusX - horizontal radius of rectangular area
+ * 
+ *              radiusY - vertical radius of rectangular area
+ * 
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : erode image by minimum value of each channel in a rectangular area , write the result into dst
+ ******************************************************************************************/
+void erode(const Image& src, Image& dst, uint32_t radiusX, uint32_t radiusY)
+{
+    morphology(src, dst, radiusX, radiusY, INT16_MAX, Minimum16());
+}
+
+
+
+/******************************************************************************************
+ * Name       : dilate
+ * 
+ * Input      : mat - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ * Output     : mat - treated image
+ * 
+ * Return     : void
+ * 
+ * Function   : dilate image by maximum value of area
+ ******************************************************************************************/
+void dilate(Image& mat, uint32_t radius)
+{
+    dilate(mat, mat, radius, radius);
+}
+
+
+
+/******************************************************************************************
+ * Name       : dilate
+ * 
+ * Input      : src - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : dilate image by maximum value of area , write the result into dst
+ ******************************************************************************************/
+void dilate(const Image& src, Image& dst, uint32_t radius)
+{
+    dilate(src, dst, radius, radius);
+}
+
+
+
+/******************************************************************************************
+ * Name       : dilate
+ * 
+ * Input      : mat - source image
+ * 
+ *              radiusX - horizontal radius of rectangular area
+ * 
+ *              radiusY - vertical radius of rectangular area
+ * 
+ * Output     : mat - treated image
+ * 
+ * Return     : void
+ * 
+ * Function   : dilate image by maximum value of each channel in a rectangular area
+ ******************************************************************************************/
+void dilate(Image& mat, uint32_t radiusX, uint32_t radiusY)
+{
+    dilate(mat, mat, radiusX, radiusY);
+}
+
+
+
+/******************************************************************************************
+ * Name       : dilate
+ * 
+ * Input      : src - source image
+ * 
+ *              radiusX - horizontal radius of rectangular area
+ * 
+ *              radiusY - vertical radius of rectangular area
+ * 
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : dilate image by maximum value of each channel in a rectangular area , write the result into dst
+ ******************************************************************************************/
+void dilate(const Image& src, Image& dst, uint32_t radiusX, uint32_t radiusY)
+{
+    morphology(src, dst, radiusX, radiusY, INT16_MIN, Maximum16());
+}
+
+
+
+/******************************************************************************************
+ * Name       : morphOpen
+ * 
+ * Input      : mat - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ * Output     : mat - treated image
+ * 
+ * Return     : void
+ * 
+ * Function   : erode and then dilate , remove small bright details
+ ******************************************************************************************/
+void morphOpen(Image& mat, uint32_t radius)
+{
+    morphOpen(mat, mat, radius);
+}
+
+
+
+/******************************************************************************************
+ * Name       : morphOpen
+ * 
+ * Input      : src - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : erode and then dilate , remove small bright details , write the result into dst
+ ******************************************************************************************/
+void morphOpen(const Image& src, Image& dst, uint32_t radius)
+{
+    erode(src, dst, radius);
+    dilate(dst, dst, radius);
+}
+
+
+
+/******************************************************************************************
+ * Name       : morphClose
+ * 
+ * Input      : mat - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ * Output     : mat - treated image
+ * 
+ * Return     : void
+ * 
+ * Function   : dilate and then erode , fill small dark details
+ ******************************************************************************************/
+void morphClose(Image& mat, uint32_t radius)
+{
+    morphClose(mat, mat, radius);
+}
+
+
+
+/******************************************************************************************
+ * Name       : morphClose
+ * 
+ * Input      : src - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : dilate and then erode , fill small dark details , write the result into dst
+ ******************************************************************************************/
+void morphClose(const Image& src, Image& dst, uint32_t radius)
+{
+    dilate(src, dst, radius);
+    erode(dst, dst, radius);
+}
+
+
+
+/******************************************************************************************
+ * Name       : morphGradient
+ * 
+ * Input      : mat - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ * Output     : mat - treated image
+ * 
+ * Return     : void
+ * 
+ * Function   : difference between dilated image and eroded image , outline of objects
+ ******************************************************************************************/
+void morphGradient(Image& mat, uint32_t radius)
+{
+    morphGradient(mat, mat, radius);
+}
+
+
+
+/******************************************************************************************
+ * Name       : morphGradient
+ * 
+ * Input      : src - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : difference between dilated image and eroded image , outline of objects , write the result into dst
+ ******************************************************************************************/
+void morphGradient(const Image& src, Image& dst, uint32_t radius)
+{
+    gradient(src, dst, radius);
+}
+
+
+
+
+
+/******************************************************************************************
+ * Name       : gaussian
+ * 
+ * Input      : mat - empty matrix
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ *              variance - sigma of Gaussian distribution
+ * 
+ * Output     : mat - Gaussian distribution Matrix
+ * 
+ * Return     : void
+ * 
+ * Function   : 1 / (2 * pi * variance * variance)  *  exp(- (x * x + y * y) / (2 * variance * variance))
+ ******************************************************************************************/
+void gaussian(Mat<double>& mat, uint32_t radius, double variance)
+{
+    double K = 1.0 / 2 / 3.1415926 / variance / variance;
+    mat.resize(2*radius + 1, 2*radius + 1);
+    for(int64_t y = -(int64_t)radius; y <= radius; y++)
+    {
+        for(int64_t x = -(int64_t)radius; x <= radius; x++)
+        {
+            mat[radius + y][radius + x] = K * exp( - ((double)(x)*x + y*y) / (2*variance*variance));
+        }
+    }
+
+    double sum = mat.reduce<double>([](double& element){return element;});
+    mat.map([sum](double& element){element /= sum;});
+}
+
+
+
+/******************************************************************************************
+ * Name       : gaussianBlur
+ * 
+ * Input      : mat - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ *              variance - sigma of Gaussian distribution
+ * 
+ * Output     : mat - treated image
+ * 
+ * Return     : void
+ * 
+ * Function   : blur image by Gaussian distribution
+ ******************************************************************************************/
+void gaussianBlur(Image& mat, uint32_t radius, double variance)
+{
+    gaussianBlur(mat, mat, radius, variance);
+}
+
+
+
+/******************************************************************************************
+ * Name       : gaussianBlur
+ * 
+ * Input      : src - source image
+ * 
+ *              radius - radius of convolution kernel
+ * 
+ *              variance - sigma of Gaussian distribution
+ * 
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : blur image by Gaussian distribution , write the result into dst
+ ******************************************************************************************/
+void gaussianBlur(const Image& src, Image& dst, uint32_t radius, double variance)
+{
+    Mat<double> rowKernel;
+    Mat<double> colKernel;
+    gaussianVectors(rowKernel, colKernel, radius, variance);
+    if(!sepConvolve(src, dst, rowKernel, colKernel))   // image is smaller than kernel
+    {
+        dst = src;
+    }
+}
+
+
+
+/******************************************************************************************
+ * Name       : resize
+ * 
+ * Input      : mat - source image
+ * 
+ *              width - width of new image
+ * 
+ *              height - height of new image
+ * 
+ * Output     : mat - treated image
+ * 
+ * Return     : void
+ * 
+ * Function   : resize a image
+ ******************************************************************************************/
+void resize(Image& mat, uint32_t width, uint32_t height)
+{
+    resize(mat, mat, width, height);
+}
+
+
+
+/******************************************************************************************
+ * Name       : resize
+ * 
+ * Input      : src - source image
+ * 
+ *              width - width of new image
+ * 
+ *              height - height of new image
+ * 
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : resize a image , write the result into dst
+ ******************************************************************************************/
+void resize(const Image& src, Image& dst, uint32_t width, uint32_t height)
+{
+    bilinear(src, dst, width, height);
+}
+
+
+
+/******************************************************************************************
+ * Name       : resize
+ * 
+ * Input      : mat - source image
+ * 
+ *              width - width of new image
+ * 
+ *              height - height of new image
+ * 
+ * Output     : mat - treated image
+ * 
+ * Return     : void
+ * 
+ * Function   : resize a image by bicubic interpolation
+ ******************************************************************************************/
+void bicubic(Image& mat, uint32_t width, uint32_t height)
+{
+    bicubic(mat, mat, width, height);
+}
+
+
+
+/******************************************************************************************
+ * Name       : resize
+ * 
+ * Input      : src - source image
+ * 
+ *              width - width of new image
+ * 
+ *              height - height of new image
+ * 
+ * Output     : dst - treated image , its buffer is reused if the size matches ,
+ *                    src and dst can be the same image
+ * 
+ * Return     : void
+ * 
+ * Function   : resize a image by bicubic interpolation , write the result into dst
+ ******************************************************************************************/
+void bicubic(const Image& src, Image& dst, uint32_t width, uint32_t height)
+{
+    /* source pixels are read after writing them */
+    if(&src == &dst)
+    {
+        const Image temp = dst;
+        bicubic(temp, dst, width, height);
+        return;
+    }
+
+    prepare(dst, width, height);
+    double kx = static_cast<double>(src.width()) / dst.width();
+    double ky = static_cast<double>(src.height()) / dst.height();
+
+    parallelFor(0, dst.height(), 8, [&](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t y = begin; y < end; y++)
+        {
+            for(uint32_t x = 0; x < dst.width(); x++)
+            {
+                double x_real = x * kx;
+                double y_real = y * ky;
+
+
+                /* find the 16 nearest Rgbpixel */
+                uint32_t x_begin, x_end;
+                uint32_t y_begin, y_end;
+
+                x_begin = x_real - 1 > 0 ? x_real - 1 : 0;
+                x_end   = x_real + 3 < src.width() ? x_real + 3 : src.width();
+
+                y_begin = y_real - 1 > 0 ? y_real - 1 : 0;
+                y_end   = y_real + 3 < src.height() ? y_real + 3 : src.height();
+
+                RgbPixel& pixel = dst[y][x];
+                pixel = 0;
+                for(uint32_t i = y_begin; i < y_end; i++)
+                {
+                    for(uint32_t j = x_begin; j < x_end; j++)
+                    {
+                        double y_offset = i > y_real ? i - y_real : y_real - i;
+                        double x_offset = j > x_real ? j - x_real : x_real - j;
+                        double k = bicubicCoefficient(x_offset) * bicubicCoefficient(y_offset);
+                        pixel.red = pixel.red + k * src[i][j].red;
+                        pixel.green = pixel.green + k * src[i][j].green;
+                        pixel.blue = pixel.blue + k * src[i][j].blue;
+
+                    }
+                }
+
+                pixel.red = pixel.red < 0 ? 0 : pixel.red > 255 ? 255 : pixel.red;
+                pixel.green = pixel.green < 0 ? 0 : pixel.green > 255 ? 255 : pixel.green;
+                pixel.blue = pixel.blue < 0 ? 0 : pixel.blue > 255 ? 255 : pixel.blue;
+            }
+        }
+    });
+}
+
+
+
+
+
+
+
+
+
+
+/**[GrayImage]********************************************************************************************/
+/* same as above , but work on compact gray-scale image of 1 byte per pixel */
+void binaryzation(GrayImage& mat, uint8_t threshold)
+{
+    binarize(mat, mat, threshold);
+}
+
+void binaryzation(const GrayImage& src, GrayImage& dst, uint8_t threshold)
+{
+    binarize(src, dst, threshold);
+}
+
+bool convolution(GrayImage& mat, Mat<double>& kernel)
+{
+    return convolve(mat, mat, kernel);
+}
+
+bool convolution(const GrayImage& src, GrayImage& dst, Mat<double>& kernel)
+{
+    return convolve(src, dst, kernel);
+}
+
+bool sepConvolution(GrayImage& mat, Mat<double>& rowKernel, Mat<double>& colKernel)
+{
+    return sepConvolve(mat, mat, rowKernel, colKernel);
+}
+
+bool sepConvolution(const GrayImage& src, GrayImage& dst, Mat<double>& rowKernel, Mat<double>& colKernel)
+{
+    return sepConvolve(src, dst, rowKernel, colKernel);
+}
+
+void detectEdge(GrayImage& mat)
+{
+    detectEdge(mat, mat);
+}
+
+void detectEdge(const GrayImage& src, GrayImage& dst)
+{
+    Mat<double> kernel;
+    edgeKernel(kernel);
+    if(!convolve(src, dst, kernel))     // image is smaller than kernel
+    {
+        dst = src;
+    }
+}
+
+void averageBlur(GrayImage& mat, uint32_t radius)
+{
+    boxBlur(mat, mat, radius);
+}
+
+void averageBlur(const GrayImage& src, GrayImage& dst, uint32_t radius)
+{
+    boxBlur(src, dst, radius);
+}
+
+void rankFilter(GrayImage& mat, uint32_t radius, double percentile)
+{
+    rankBlur(mat, mat, radius, percentile);
+}
+
+void rankFilter(const GrayImage& src, GrayImage& dst, uint32_t radius, double percentile)
+{
+    rankBlur(src, dst, radius, percentile);
+}
+
+void medianBlur(GrayImage& mat, uint32_t radius)
+{
+    rankBlur(mat, mat, radius, 50);
+}
+
+void medianBlur(const GrayImage& src, GrayImage& dst, uint32_t radius)
+{
+    rankBlur(src, dst, radius, 50);
+}
+
+void erode(GrayImage& mat, uint32_t radius)
+{
+    erode(mat, mat, radius, radius);
+}
+
+void erode(const GrayImage& src, GrayImage& dst, uint32_t radius)
+{
+    erode(src, dst, radius, radius);
+}
+
+void erode(GrayImage& mat, uint32_t radiusX, uint32_t radiusY)
+{
+    erode(mat, mat, radiusX, radiusY);
+}
+
+void erode(const GrayImage& src, GrayImage& dst, uint32_t radiusX, uint32_t radiusY)
+{
+    morphology(src, dst, radiusX, radiusY, INT16_MAX, Minimum16());
+}
+
+void dilate(GrayImage& mat, uint32_t radius)
+{
+    dilate(mat, mat, radius, radius);
+}
+
+void dilate(const GrayImage& src, GrayImage& dst, uint32_t radius)
+{
+    dilate(src, dst, radius, radius);
+}
+
+void dilate(GrayImage& mat, uint32_t radiusX, uint32_t radiusY)
+{
+    dilate(mat, mat, radiusX, radiusY);
+}
+
+void dilate(const GrayImage& src, GrayImage& dst, uint32_t radiusX, uint32_t radiusY)
+{
+    morphology(src, dst, radiusX, radiusY, INT16_MIN, Maximum16());
+}
+
+void morphOpen(GrayImage& mat, uint32_t radius)
+{
+    morphOpen(mat, mat, radius);
+}
+
+void morphOpen(const GrayImage& src, GrayImage& dst, uint32_t radius)
+{
+    erode(src, dst, radius);
+    dilate(dst, dst, radius);
+}
+
+void morphClose(GrayImage& mat, uint32_t radius)
+{
+    morphClose(mat, mat, radius);
+}
+
+void morphClose(const GrayImage& src, GrayImage& dst, uint32_t radius)
+{
+    dilate(src, dst, radius);
+    erode(dst, dst, radius);
+}
+
+void morphGradient(GrayImage& mat, uint32_t radius)
+{
+    gradient(mat, mat, radius);
+}
+
+void morphGradient(const GrayImage& src, GrayImage& dst, uint32_t radius)
+{
+    gradient(src, dst, radius);
+}
+
+void gaussianBlur(GrayImage& mat, uint32_t radius, double variance)
+{
+    gaussianBlur(mat, mat, radius, variance);
+}
+
+void gaussianBlur(const GrayImage& src, GrayImage& dst, uint32_t radius, double variance)
+{
+    Mat<double> rowKernel;
+    Mat<double> colKernel;
+    gaussianVectors(rowKernel, colKernel, radius, variance);
+    if(!sepConvolve(src, dst, rowKernel, colKernel))   // image is smaller than kernel
+    {
+        dst = src;
+    }
+}
+
+void resize(GrayImage& mat, uint32_t width, uint32_t height)
+{
+    bilinear(mat, mat, width, height);
+}
+
+void resize(const GrayImage& src, GrayImage& dst, uint32_t width, uint32_t height)
+{
+    bilinear(src, dst, width, height);
+}
+
+
+
+
+/**[Rgb24Image]*******************************************************************************************/
+/* same as above , but work on packed images of 3 bytes per pixel */
+void grayScale(const Rgb24Image& src, GrayImage& dst)
+{
+    grayPacked(src, dst);
+}
+
+bool convolution(Rgb24Image& mat, Mat<double>& kernel)
+{
+    return convolve(mat, mat, kernel);
+}
+
+bool convolution(const Rgb24Image& src, Rgb24Image& dst, Mat<double>& kernel)
+{
+    return convolve(src, dst, kernel);
+}
+
+bool sepConvolution(Rgb24Image& mat, Mat<double>& rowKernel, Mat<double>& colKernel)
+{
+    return sepConvolve(mat, mat, rowKernel, colKernel);
+}
+
+bool sepConvolution(const Rgb24Image& src, Rgb24Image& dst, Mat<double>& rowKernel, Mat<double>& colKernel)
+{
+    return sepConvolve(src, dst, rowKernel, colKernel);
+}
+
+void averageBlur(Rgb24Image& mat, uint32_t radius)
+{
+    boxBlur(mat, mat, radius);
+}
+
+void averageBlur(const Rgb24Image& src, Rgb24Image& dst, uint32_t radius)
+{
+    boxBlur(src, dst, radius);
+}
+
+void rankFilter(Rgb24Image& mat, uint32_t radius, double percentile)
+{
+    rankBlur(mat, mat, radius, percentile);
+}
+
+void rankFilter(const Rgb24Image& src, Rgb24Image& dst, uint32_t radius, double percentile)
+{
+    rankBlur(src, dst, radius, percentile);
+}
+
+void medianBlur(Rgb24Image& mat, uint32_t radius)
+{
+    rankBlur(mat, mat, radius, 50);
+}
+
+void medianBlur(const Rgb24Image& src, Rgb24Image& dst, uint32_t radius)
+{
+    rankBlur(src, dst, radius, 50);
+}
+
+void gaussianBlur(Rgb24Image& mat, uint32_t radius, double variance)
+{
+    gaussianBlur(mat, mat, radius, variance);
+}
+
+void gaussianBlur(const Rgb24Image& src, Rgb24Image& dst, uint32_t radius, double variance)
+{
+    Mat<double> rowKernel;
+    Mat<double> colKernel;
+    gaussianVectors(rowKernel, colKernel, radius, variance);
+    if(!sepConvolve(src, dst, rowKernel, colKernel))   // image is smaller than kernel
+    {
+        dst = src;
+    }
+}
+
+void resize(Rgb24Image& mat, uint32_t width, uint32_t height)
+{
+    bilinear(mat, mat, width, height);
+}
+
+void resize(const Rgb24Image& src, Rgb24Image& dst, uint32_t width, uint32_t height)
+{
+    bilinear(src, dst, width, height);
+}
+
+
+
+
+/**[Rgba32Image]******************************************************************************************/
+/* same as above , but work on packed images of 4 bytes per pixel , alpha is kept */
+void grayScale(const Rgba32Image& src, GrayImage& dst)
+{
+    grayPacked(src, dst);
+}
+
+bool convolution(Rgba32Image& mat, Mat<double>& kernel)
+{
+    return convolve(mat, mat, kernel);
+}
+
+bool convolution(const Rgba32Image& src, Rgba32Image& dst, Mat<double>& kernel)
+{
+    return convolve(src, dst, kernel);
+}
+
+bool sepConvolution(Rgba32Image& mat, Mat<double>& rowKernel, Mat<double>& colKernel)
+{
+    return sepConvolve(mat, mat, rowKernel, colKernel);
+}
+
+bool sepConvolution(const Rgba32Image& src, Rgba32Image& dst, Mat<double>& rowKernel, Mat<double>& colKernel)
+{
+    return sepConvolve(src, dst, rowKernel, colKernel);
+}
+
+void averageBlur(Rgba32Image& mat, uint32_t radius)
+{
+    boxBlur(mat, mat, radius);
+}
+
+void averageBlur(const Rgba32Image& src, Rgba32Image& dst, uint32_t radius)
+{
+    boxBlur(src, dst, radius);
+}
+
+void rankFilter(Rgba32Image& mat, uint32_t radius, double percentile)
+{
+    rankBlur(mat, mat, radius, percentile);
+}
+
+void rankFilter(const Rgba32Image& src, Rgba32Image& dst, uint32_t radius, double percentile)
+{
+    rankBlur(src, dst, radius, percentile);
+}
+
+void medianBlur(Rgba32Image& mat, uint32_t radius)
+{
+    rankBlur(mat, mat, radius, 50);
+}
+
+void medianBlur(const Rgba32Image& src, Rgba32Image& dst, uint32_t radius)
+{
+    rankBlur(src, dst, radius, 50);
+}
+
+void gaussianBlur(Rgba32Image& mat, uint32_t radius, double variance)
+{
+    gaussianBlur(mat, mat, radius, variance);
+}
+
+void gaussianBlur(const Rgba32Image& src, Rgba32Image& dst, uint32_t radius, double variance)
+{
+    Mat<double> rowKernel;
+    Mat<double> colKernel;
+    gaussianVectors(rowKernel, colKernel, radius, variance);
+    if(!sepConvolve(src, dst, rowKernel, colKernel))   // image is smaller than kernel
+    {
+        dst = src;
+    }
+}
+
+void resize(Rgba32Image& mat, uint32_t width, uint32_t height)
+{
+    bilinear(mat, mat, width, height);
+}
+
+void resize(const Rgba32Image& src, Rgba32Image& dst, uint32_t width, uint32_t height)
+{
+    bilinear(src, dst, width, height);
+}
+
+
+
+
+
+/**[Private]***********************************************************************************************/
+/* Kittler threshold , by the first channel */
+template<typename Pixel>
+static uint8_t kittler(const Mat<Pixel>& mat)
+{
+    if(mat.width() < 3 || mat.height() < 3)
+    {
+        return 128;
+    }
+
+    std::atomic<uintmax_t> sumGrads(0);
+    std::atomic<uintmax_t> sumGrayGrads(0);
+    parallelFor(1, mat.height()-1, 16, [&](uint32_t begin, uint32_t end)
+    {
+        uintmax_t grads = 0;
+        uintmax_t grayGrads = 0;
+        for(uint32_t i = begin; i < end; i++)
+        {
+            for(uint32_t j = 1; j < mat.width()-1; j++)
+            {
+                int16_t left   = Channels<Pixel>::get(mat[i][j-1], 0);
+                int16_t right  = Channels<Pixel>::get(mat[i][j+1], 0);
+                int16_t top    = Channels<Pixel>::get(mat[i-1][j], 0);
+                int16_t bottom = Channels<Pixel>::get(mat[i+1][j], 0);
+                uint8_t grad = std::max(std::abs(left - right) , std::abs(top - bottom));
+                grads += grad;
+                grayGrads += grad * Channels<Pixel>::get(mat[i][j], 0);
+            }
+        }
+        sumGrads += grads;
+        sumGrayGrads += grayGrads;
+    });
+
+    /* flat image */
+    if(sumGrads == 0)
+    {
+        return 128;
+    }
+
+    return sumGrayGrads / sumGrads;
+}
+
+template<typename Pixel>
+static void binarize(const Mat<Pixel>& src, Mat<Pixel>& dst, uint8_t threshold)
+{
+    if(threshold == 0)
+    {
+        threshold = kittler(src);
+    }
+
+    if(&src == &dst)
+    {
+        dst.detach();
+    }
+    else
+    {
+        prepare(dst, src.width(), src.height());
+    }
+
+    parallelFor(0, src.height(), 16, [&](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t y = begin; y < end; y++)
+        {
+            if(&src != &dst)
+            {
+                memcpy(&dst[y][0], &src[y][0], sizeof(Pixel) * src.width());
+            }
+            thresholdPixels(&dst[y][0], src.width(), threshold);
+        }
+    });
+}
+
+
+template<typename Pixel>
+static bool convolve(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<double>& kernel)
+{
+    if( kernel.width() != kernel.height() ||    // not a square
+        (kernel.width() & 1) != 1 ||              // length of side is not a odd number
+        kernel.width() > src.width() ||         // kernel is bigger than mat
+        kernel.width() > src.height())
+    {
+        return false;
+    }
+
+    /* rank-1 kernel , run it as a horizontal pass and a vertical pass */
+    Mat<double> rowKernel;
+    Mat<double> colKernel;
+    if(separate(kernel, rowKernel, colKernel))
+    {
+        return sepConvolve(src, dst, rowKernel, colKernel);
+    }
+
+    /* source pixels are read after writing them */
+    if(&src == &dst)
+    {
+        const Mat<Pixel> backup = source(dst);
+        return convolve(backup, dst, kernel);
+    }
+
+    prepare(dst, src.width(), src.height());
+
+    /* large kernels are much faster by FFT , it costs log of the tile size instead of the kernel area */
+    uint32_t tileWidth = fftTile(src.width(), kernel.width());
+    uint32_t tileHeight = fftTile(src.height(), kernel.width());
+    if(fftPays(kernel.width(), tileWidth, tileHeight))
+    {
+        fftConvolve(src, dst, kernel, tileWidth, tileHeight);
+        return true;
+    }
+
+    parallelFor(0, src.height(), 4, [&](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t y = begin; y < end; y++)
+        {
+            Pixel* pixels = &dst[y][0];
+            for(uint32_t x = 0; x < src.width(); x++)
+            {
+                pixels[x] = convolutionElement(src, y, x, kernel);
+            }
+        }
+    });
+
+    return true;
+}
+
+
+template<typename Pixel>
+static bool sepConvolve(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<double>& rowKernel, const Mat<double>& colKernel)
+{
+    if( rowKernel.height() != 1 || colKernel.width() != 1 ||                    // not a vector
+        (rowKernel.width() & 1) != 1 || (colKernel.height() & 1) != 1 ||        // length is not a odd number
+        rowKernel.width() > src.width() ||                                      // kernel is bigger than mat
+        colKernel.height() > src.height())
+    {
+        return false;
+    }
+
+    const int channels = Channels<Pixel>::count;
+    uint32_t w = src.width();
+    uint32_t h = src.height();
+    int64_t rowRadius = (rowKernel.width() - 1) / 2;
+    int64_t colRadius = (colKernel.height() - 1) / 2;
+
+    /* horizontal pass , keep the unclamped sums , channel c of pixel x is at [c * w + x] */
+    Mat<double> plane(channels * w, h);
+    parallelFor(0, h, 8, [&](uint32_t first, uint32_t last)
+    {
+        std::vector<double> line(channels * w);
+        for(uint32_t y = first; y < last; y++)
+        {
+            double* sums = &plane[y][0];
+            const Pixel* pixels = &src[y][0];
+            for(int c = 0; c < channels; c++)
+            {
+                for(uint32_t x = 0; x < w; x++)
+                {
+                    line[c * w + x] = Channels<Pixel>::get(pixels[x], c);
+                    sums[c * w + x] = 0;
+                }
+            }
+
+            for(int64_t t = -rowRadius; t <= rowRadius; t++)
+            {
+                double k = rowKernel[0][rowRadius + t];
+                int64_t begin = t < 0 ? -t : 0;
+                int64_t end   = t > 0 ? w - t : w;
+                for(int c = 0; c < channels; c++)
+                {
+                    double* dst = sums + c * w;
+                    const double* src = &line[c * w];
+                    for(int64_t x = begin; x < end; x++)
+                    {
+                        dst[x] += k * src[x + t];
+                    }
+                }
+            }
+        }
+    });
+
+    /* vertical pass , src is not read anymore , so it can be dst */
+    if(&src == &dst)
+    {
+        dst.detach();
+    }
+    else
+    {
+        prepare(dst, w, h);
+    }
+
+    parallelFor(0, h, 8, [&](uint32_t first, uint32_t last)
+    {
+        std::vector<double> sum(channels * w);
+        for(int64_t y = first; y < last; y++)
+        {
+            std::fill(sum.begin(), sum.end(), 0);
+
+            int64_t begin = y > colRadius ? y - colRadius : 0;
+            int64_t end   = y + colRadius + 1 < h ? y + colRadius + 1 : h;
+            for(int64_t i = begin; i < end; i++)
+            {
+                double k = colKernel[colRadius - y + i][0];
+                const double* src = &plane[i][0];
+                for(uint32_t x = 0; x < channels * w; x++)
+                {
+                    sum[x] += k * src[x];
+                }
+            }
+
+            Pixel* pixels = &dst[y][0];
+            const Pixel* sources = &src[y][0];
+            for(uint32_t x = 0; x < w; x++)
+            {
+                Channels<Pixel>::rest(pixels[x], sources[x]);
+            }
+
+            for(int c = 0; c < channels; c++)
+            {
+                for(uint32_t x = 0; x < w; x++)
+                {
+                    double value = sum[c * w + x] + roundOffBias;
+                    Channels<Pixel>::set(pixels[x], c, value < 0 ? 0 : value > 255 ? 255 : value);
+                }
+            }
+        }
+    });
+
+    return true;
+}
+
+
+/*
+ * overlap-save : every tile of the result is cut from a circular correlation of a block of src ,
+ * the block is the tile and the kernel radius around it , zeros out of the image ;
+ * the spectrum of the kernel is made once , and tiles are transformed independently
+ */
+template<typename Pixel>
+static void fftConvolve(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<double>& kernel, uint32_t tileWidth, uint32_t tileHeight)
+{
+    const int channels = Channels<Pixel>::count;
+    uint32_t w = src.width();
+    uint32_t h = src.height();
+    uint32_t side = kernel.width();
+    int64_t radius = (side - 1) / 2;
+
+    /* correlation is a product with the conjugate spectrum , the kernel is not flipped */
+    Mat<double> plane(tileWidth, tileHeight);
+    plane.map([](double& value){ value = 0; });
+    for(uint32_t y = 0; y < side; y++)
+    {
+        for(uint32_t x = 0; x < side; x++)
+        {
+            plane[y][x] = kernel[y][x];
+        }
+    }
+
+    Mat<std::complex<double>> spectrum;
+    dft(plane, spectrum);
+    spectrum.map([](std::complex<double>& value){ value = std::conj(value); });
+
+    /* outputs of a tile , the rest of the block wraps around */
+    uint32_t outWidth = tileWidth - side + 1;
+    uint32_t outHeight = tileHeight - side + 1;
+    uint32_t columns = (w + outWidth - 1) / outWidth;
+    uint32_t rows = (h + outHeight - 1) / outHeight;
+    parallelFor(0, columns * rows, 1, [&](uint32_t first, uint32_t last)
+    {
+        Mat<double> block(tileWidth, tileHeight);
+        Mat<std::complex<double>> product;
+        Mat<double> result;
+        for(uint32_t t = first; t < last; t++)
+        {
+            uint32_t left = (t % columns) * outWidth;
+            uint32_t top = (t / columns) * outHeight;
+            uint32_t right = left + outWidth < w ? left + outWidth : w;
+            uint32_t bottom = top + outHeight < h ? top + outHeight : h;
+
+            for(uint32_t y = top; y < bottom; y++)
+            {
+                const Pixel* sources = &src[y][0];
+                Pixel* pixels = &dst[y][0];
+                for(uint32_t x = left; x < right; x++)
+                {
+                    Channels<Pixel>::rest(pixels[x], sources[x]);
+                }
+            }
+
+            for(int c = 0; c < channels; c++)
             {
-                for(uint32_t j = x_begin; j < x_end; j++)
+                for(uint32_t j = 0; j < tileHeight; j++)
+                {
+                    int64_t y = top + j - radius;
+                    double* values = &block[j][0];
+                    for(uint32_t i = 0; i < tileWidth; i++)
+                    {
+                        int64_t x = left + i - radius;
+                        values[i] = (y >= 0 && y < h && x >= 0 && x < w) ? Channels<Pixel>::get(src[y][x], c) : 0;
+                    }
+                }
+
+                dft(block, product);
+                for(uint32_t j = 0; j < product.height(); j++)
+                {
+                    std::complex<double>* values = &product[j][0];
+                    const std::complex<double>* factors = &spectrum[j][0];
+                    for(uint32_t i = 0; i < product.width(); i++)
+                    {
+                        values[i] = std::complex<double>(
+                            values[i].real() * factors[i].real() - values[i].imag() * factors[i].imag(),
+                            values[i].real() * factors[i].imag() + values[i].imag() * factors[i].real());
+                    }
+                }
+                idft(product, result, tileWidth);
+
+                for(uint32_t y = top; y < bottom; y++)
                 {
-                    double y_offset = i > y_real ? i - y_real : y_real - i;
-                    double x_offset = j > x_real ? j - x_real : x_real - j;
-                    double k = bicubicCoefficient(x_offset) * bicubicCoefficient(y_offset);
-                    mat[y][x].red = mat[y][x].red + k * temp[i][j].red;
-                    mat[y][x].green = mat[y][x].green + k * temp[i][j].green;
-                    mat[y][x].blue = mat[y][x].blue + k * temp[i][j].blue;
+                    const double* values = &result[y - top][0];
+                    Pixel* pixels = &dst[y][0];
+                    for(uint32_t x = left; x < right; x++)
+                    {
+                        double value = values[x - left] + roundOffBias;
+                        Channels<Pixel>::set(pixels[x], c, value < 0 ? 0 : value > 255 ? 255 : value);
+                    }
+                }
+            }
+        }
+    });
+}
+
+
+/* 
+ * sums of the window are kept by running sums , so the cost doesn't depend on radius ;
+ * the window is truncated at the border but always divided by the whole kernel area
+ */
+template<typename Pixel>
+static void boxBlur(const Mat<Pixel>& src, Mat<Pixel>& dst, uint32_t radius)
+{
+    uint64_t size = 2 * (uint64_t)radius + 1;
+    if(size > src.width() || size > src.height())   // kernel is bigger than mat
+    {
+        dst = src;
+        return;
+    }
+
+    /* source pixels are read after writing them */
+    if(&src == &dst)
+    {
+        const Mat<Pixel> backup = source(dst);
+        boxBlur(backup, dst, radius);
+        return;
+    }
 
+    const int channels = Channels<Pixel>::count;
+    int64_t area = size * size;
+    uint32_t w = src.width();
+    uint32_t h = src.height();
+    prepare(dst, w, h);
+
+    /* every band of rows starts its own running sums , so bands are much higher than the window */
+    parallelFor(0, h, 4 * radius + 16, [&](uint32_t first, uint32_t last)
+    {
+        /* sums of each column over rows in the window , channel c of column x is at [c * w + x] */
+        std::vector<int64_t> column(channels * w, 0);
+        auto slide = [&](uint32_t y, int64_t sign)
+        {
+            for(int c = 0; c < channels; c++)
+            {
+                for(uint32_t x = 0; x < w; x++)
+                {
+                    column[c * w + x] += sign * Channels<Pixel>::get(src[y][x], c);
                 }
             }
+        };
 
-            mat[y][x].red = mat[y][x].red < 0 ? 0 : mat[y][x].red > 255 ? 255 : mat[y][x].red;
-            mat[y][x].green = mat[y][x].green < 0 ? 0 : mat[y][x].green > 255 ? 255 : mat[y][x].green;
-            mat[y][x].blue = mat[y][x].blue < 0 ? 0 : mat[y][x].blue > 255 ? 255 : mat[y][x].blue;
+        /* window of the first row , except its last row */
+        for(uint32_t y = first > radius ? first - radius : 0; y < first + radius && y < h; y++)
+        {
+            slide(y, 1);
         }
-    }
-}
 
+        for(uint32_t y = first; y < last; y++)
+        {
+            /* slide the window down */
+            if(y + radius < h)
+            {
+                slide(y + radius, 1);
+            }
+
+            if(y > radius && y > first)
+            {
+                slide(y - radius - 1, -1);
+            }
+
+            /* slide the window right */
+            Pixel* pixels = &dst[y][0];
+            const Pixel* sources = &src[y][0];
+            for(uint32_t x = 0; x < w; x++)
+            {
+                Channels<Pixel>::rest(pixels[x], sources[x]);
+            }
+
+            for(int c = 0; c < channels; c++)
+            {
+                const int64_t* sums = &column[c * w];
+                int64_t sum = 0;
+                for(uint32_t x = 0; x < radius; x++)
+                {
+                    sum += sums[x];
+                }
 
+                for(uint32_t x = 0; x < w; x++)
+                {
+                    if(x + radius < w)
+                    {
+                        sum += sums[x + radius];
+                    }
 
+                    if(x > radius)
+                    {
+                        sum -= sums[x - radius - 1];
+                    }
 
+                    Channels<Pixel>::set(pixels[x], c, sum < 0 ? 0 : sum / area > 255 ? 255 : sum / area);
+                }
+            }
+        }
+    });
+}
 
 
+template<typename Pixel>
+static void rankBlur(const Mat<Pixel>& src, Mat<Pixel>& dst, uint32_t radius, double percentile)
+{
+    /* source pixels are read after writing them */
+    if(&src == &dst)
+    {
+        const Mat<Pixel> backup = source(dst);
+        rankBlur(backup, dst, radius, percentile);
+        return;
+    }
 
+    percentile = percentile < 0 ? 0 : percentile > 100 ? 100 : percentile;
+    prepare(dst, src.width(), src.height());
+
+    /* 
+     * work on strips of columns so that the column histograms fit in cache ,
+     * and on bands of rows so that there are enough tasks for all threads
+     */
+    const uint32_t strip = 256;
+    const uint32_t band = 8 * radius > 128 ? 8 * radius : 128;
+    uint32_t strips = (src.width() + strip - 1) / strip;
+    uint32_t bands = (src.height() + band - 1) / band;
+    parallelFor(0, strips * bands, 1, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t i = first; i < last; i++)
+        {
+            uint32_t left = i % strips * strip;
+            uint32_t right = left + strip < src.width() ? left + strip : src.width();
+            uint32_t top = i / strips * band;
+            uint32_t bottom = top + band < src.height() ? top + band : src.height();
+            for(uint32_t y = top; y < bottom; y++)
+            {
+                for(uint32_t x = left; x < right; x++)
+                {
+                    Channels<Pixel>::rest(dst[y][x], src[y][x]);
+                }
+            }
 
+            for(int c = 0; c < Channels<Pixel>::count; c++)
+            {
+                rankStrip(src, dst, c, radius, percentile, left, right, top, bottom);
+            }
+        }
+    });
+}
 
 
-/**[Private]***********************************************************************************************/
-static RgbPixel convolutionElement(Image& mat, uint32_t row, uint32_t column, Mat<double>& kernel)
+template<typename Pixel>
+static void gradient(const Mat<Pixel>& src, Mat<Pixel>& dst, uint32_t radius)
+{
+    Mat<Pixel> eroded;
+    morphology(src, eroded, radius, radius, INT16_MAX, Minimum16());
+    morphology(src, dst, radius, radius, INT16_MIN, Maximum16());
+    parallelFor(0, dst.height(), 16, [&](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t y = begin; y < end; y++)
+        {
+            Pixel* pixels = &dst[y][0];
+            const Pixel* minimums = &eroded[y][0];
+            for(uint32_t x = 0; x < dst.width(); x++)
+            {
+                for(int c = 0; c < Channels<Pixel>::count; c++)
+                {
+                    int16_t value = Channels<Pixel>::get(pixels[x], c) - Channels<Pixel>::get(minimums[x], c);
+                    Channels<Pixel>::set(pixels[x], c, value);
+                }
+            }
+        }
+    });
+}
+
+
+template<typename Pixel>
+static Pixel convolutionElement(const Mat<Pixel>& mat, uint32_t row, uint32_t column, const Mat<double>& kernel)
 {
-    RgbPixel result = 0;
+    Pixel result = mat[row][column];
     uint32_t radius = (kernel.width() - 1 ) / 2;
 
     uint32_t row_begin = (row > radius) ? (row - radius) : 0;
@@ -450,50 +1930,485 @@ static RgbPixel convolutionElement(Image& mat, uint32_t row, uint32_t column, Ma
     uint32_t column_begin = (column > radius) ? (column - radius) : 0;
     uint32_t column_end   = (mat.width() >= radius + column + 1) ? (radius + column + 1) : mat.width();
     
-    double red   = 0;
-    double green = 0;
-    double blue  = 0;
-
-    for(uint32_t y = row_begin; y < row_end; y++)
+    for(int c = 0; c < Channels<Pixel>::count; c++)
     {
-        for(uint32_t x = column_begin; x < column_end; x++)
+        double sum = roundOffBias;
+        for(uint32_t y = row_begin; y < row_end; y++)
         {
-            red += (double)(mat[y][x].red) * kernel[radius - row + y][radius - column + x];
-            green += (double)(mat[y][x].green) * kernel[radius - row + y][radius - column + x];
-            blue += (double)(mat[y][x].blue) * kernel[radius - row + y][radius - column + x];
+            for(uint32_t x = column_begin; x < column_end; x++)
+            {
+                sum += (double)(Channels<Pixel>::get(mat[y][x], c)) * kernel[radius - row + y][radius - column + x];
+            }
         }
+
+        Channels<Pixel>::set(result, c, sum < 0 ? 0 : sum > 255 ? 255 : sum);
     }
-  
-    result.red = red < 0 ? 0 : red > 255 ? 255 : red;
-    result.green = green < 0 ? 0 : green > 255 ? 255 : green;
-    result.blue = blue < 0 ? 0 : blue > 255 ? 255 : blue;
-    // std::cout << red << " " << green << " " << blue << std::endl;
 
     return result;
 }
 
+/* resize by bilinear interpolation , channels are truncated , the rest is taken from the nearest top-left pixel */
+template<typename Pixel>
+static void bilinear(const Mat<Pixel>& src, Mat<Pixel>& dst, uint32_t width, uint32_t height)
+{
+    /* source pixels are read after writing them */
+    if(&src == &dst)
+    {
+        const Mat<Pixel> temp = dst;
+        bilinear(temp, dst, width, height);
+        return;
+    }
+
+    prepare(dst, width, height);
+    double kx = static_cast<double>(src.width()) / dst.width();
+    double ky = static_cast<double>(src.height()) / dst.height();
+
+    parallelFor(0, dst.height(), 8, [&](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t y = begin; y < end; y++)
+        {
+            Pixel* pixels = &dst[y][0];
+            for(uint32_t x = 0; x < dst.width(); x++)
+            {
+                double x_real = x * kx;
+                double y_real = y * ky;
+
+                uint32_t x_src = (uint32_t)x_real;
+                uint32_t y_src = (uint32_t)y_real;
+
+                double x_offset = x_real - x_src;
+                double y_offset = y_real - y_src;
+
+                int x_another = x_src + 1 < src.width() ? x_src + 1 : x_src - 1;
+                int y_another = y_src + 1 < src.height() ? y_src + 1 : y_src - 1;
+
+                for(int c = 0; c < Channels<Pixel>::count; c++)
+                {
+                    double value =    y_offset * x_offset * Channels<Pixel>::get(src[y_src][x_src], c)
+                                    + (1 - y_offset) * x_offset * Channels<Pixel>::get(src[y_another][x_src], c)
+                                    + y_offset * (1 - x_offset) * Channels<Pixel>::get(src[y_src][x_another], c)
+                                    + (1 - y_offset) * (1 - x_offset) * Channels<Pixel>::get(src[y_another][x_another], c);
+                    Channels<Pixel>::set(pixels[x], c, static_cast<int16_t>(value));
+                }
+                Channels<Pixel>::rest(pixels[x], src[y_src][x_src]);
+            }
+        }
+    });
+}
 
-static RgbPixel traverse(Image& mat, uint32_t row, uint32_t column, uint32_t radius, std::function<RgbPixel(std::vector<RgbPixel>&)> callback)
+/* luma of packed pixels , same as rgb2gray */
+template<typename Pixel>
+static void grayPacked(const Mat<Pixel>& src, GrayImage& dst)
 {
-    std::vector<RgbPixel> temp;
-    
-    uint32_t row_begin = (row > radius) ? (row - radius) : 0;
-    uint32_t row_end   = (mat.height() >= radius + row + 1) ? (radius + row + 1) : mat.height();
+    prepare(dst, src.width(), src.height());
+    parallelFor(0, src.height(), 16, [&](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t y = begin; y < end; y++)
+        {
+            const Pixel* pixels = &src[y][0];
+            uint8_t* grays = &dst[y][0];
+            for(uint32_t x = 0; x < src.width(); x++)
+            {
+                grays[x] = saturate(luma(pixels[x].red, pixels[x].green, pixels[x].blue));
+            }
+        }
+    });
+}
 
-    uint32_t column_begin = (column > radius) ? (column - radius) : 0;
-    uint32_t column_end   = (mat.width() >= radius + column + 1) ? (radius + column + 1) : mat.width();
-    
-    for(uint32_t y = row_begin; y < row_end; y++)
+/* 
+ * Elements of mat before an operator which writes every pixel of it.
+ * mat gets a new buffer and the old one is returned without copy , 
+ * but a view , or a Mat with views , has to be written in place so that views see the result ,
+ * then its elements are copied.
+ */
+template<typename Pixel>
+static Mat<Pixel> source(Mat<Pixel>& mat)
+{
+    if(mat.isView() || mat.hasViews())
+    {
+        return Mat<Pixel>(mat);
+    }
+
+    Mat<Pixel> src = std::move(mat);
+    mat = Mat<Pixel>(src.width(), src.height());
+    return src;
+}
+
+/* dst gets the size , its buffer is kept if the size matches and it's not shared */
+template<typename Pixel>
+static void prepare(Mat<Pixel>& dst, uint32_t width, uint32_t height)
+{
+    if(dst.width() != width || dst.height() != height || dst.isShared())
+    {
+        dst = Mat<Pixel>(width, height);
+    }
+}
+
+
+/* size of FFT blocks along a side of the image , a block holds the tile of results and the kernel around it */
+static uint32_t fftTile(uint32_t size, uint32_t side)
+{
+    uint32_t whole = fftSize(size + side - 1);
+    uint32_t tile = fftSize(4 * (side - 1) > 128 ? 4 * (side - 1) : 128);
+    return whole < tile ? whole : tile;
+}
+
+/*
+ * compare multiplications of a result , side * side by the direct way ,
+ * and about 2 transforms of a block shared by the results of its tile ;
+ * the direct way does well on small kernels , it's simple and has no overhead
+ */
+static bool fftPays(uint32_t side, uint32_t tileWidth, uint32_t tileHeight)
+{
+    double area = static_cast<double>(tileWidth) * tileHeight;
+    double results = static_cast<double>(tileWidth - side + 1) * (tileHeight - side + 1);
+    double direct = static_cast<double>(side) * side;
+    double transform = fftCost * area * std::log2(area) / results;
+    return transform < direct;
+}
+
+/* split a rank-1 kernel into colKernel * rowKernel , return false if it isn't rank-1 */
+static bool separate(const Mat<double>& kernel, Mat<double>& rowKernel, Mat<double>& colKernel)
+{
+    uint32_t size = kernel.width();
+
+    /* the largest element is the pivot */
+    uint32_t pivotRow = 0;
+    uint32_t pivotColumn = 0;
+    for(uint32_t y = 0; y < size; y++)
+    {
+        for(uint32_t x = 0; x < size; x++)
+        {
+            if(std::fabs(kernel[y][x]) > std::fabs(kernel[pivotRow][pivotColumn]))
+            {
+                pivotRow = y;
+                pivotColumn = x;
+            }
+        }
+    }
+
+    double pivot = kernel[pivotRow][pivotColumn];
+    if(pivot == 0)
+    {
+        return false;
+    }
+
+    rowKernel.resize(size, 1);
+    colKernel.resize(1, size);
+    for(uint32_t i = 0; i < size; i++)
+    {
+        rowKernel[0][i] = kernel[pivotRow][i];
+        colKernel[i][0] = kernel[i][pivotColumn] / pivot;
+    }
+
+    /* every element should be the product of its row factor and column factor */
+    double tolerance = std::fabs(pivot) * 1e-9;
+    for(uint32_t y = 0; y < size; y++)
+    {
+        for(uint32_t x = 0; x < size; x++)
+        {
+            if(std::fabs(colKernel[y][0] * rowKernel[0][x] - kernel[y][x]) > tolerance)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* 
+ * Perreault-Hebert median filtering , extended to any rank :
+ * a histogram of each column is slid down , the histogram of the window is slid right by 
+ * adding and removing column histograms . Histograms have 16 coarse bins and 256 fine bins ,
+ * the fine bins of the window are only brought up to date for the coarse bin which holds 
+ * the rank , so the cost of each pixel doesn't depend on radius.
+ * Columns [begin, end) of rows [top, bottom) are written , column histograms of this strip stay in cache.
+ */
+template<typename Pixel>
+static void rankStrip(const Mat<Pixel>& src, Mat<Pixel>& dst, int channel, uint32_t radius, double percentile, uint32_t begin, uint32_t end, uint32_t top, uint32_t bottom)
+{
+    int64_t w = src.width();
+    int64_t h = src.height();
+    int64_t r = radius;
+
+    /* columns covered by the windows of this strip */
+    int64_t first = begin > r ? begin - r : 0;
+    int64_t last  = end + r < w ? end + r : w;
+    std::vector<uint16_t> columnFine((last - first) * 256, 0);
+    std::vector<uint16_t> columnCoarse((last - first) * 16, 0);
+
+    auto update = [&](int64_t y, int delta)
+    {
+        for(int64_t x = first; x < last; x++)
+        {
+            int16_t value = Channels<Pixel>::get(src[y][x], channel);
+            uint8_t bin = value < 0 ? 0 : value > 255 ? 255 : value;
+            columnFine[(x - first) * 256 + bin] += delta;
+            columnCoarse[(x - first) * 16 + (bin >> 4)] += delta;
+        }
+    };
+
+    auto add = [](uint32_t* bins, const uint16_t* column, int n)
+    {
+        for(int i = 0; i < n; i++)
+        {
+            bins[i] += column[i];
+        }
+    };
+
+    auto sub = [](uint32_t* bins, const uint16_t* column, int n)
+    {
+        for(int i = 0; i < n; i++)
+        {
+            bins[i] -= column[i];
+        }
+    };
+
+    /* window of the first row , except its last row */
+    for(int64_t y = top > r ? top - r : 0; y < top + r && y < h; y++)
+    {
+        update(y, 1);
+    }
+
+    uint32_t coarse[16];
+    uint32_t fine[16][16];
+    int64_t fineColumn[16];     // fine[i] counts the window centered on this column
+    for(int64_t y = top; y < bottom; y++)
     {
-        for(uint32_t x = column_begin; x < column_end; x++)
+        /* slide column histograms down */
+        if(y + r < h)
+        {
+            update(y + r, 1);
+        }
+        if(y > r && y > top)
         {
-            temp.push_back(mat[y][x]); 
+            update(y - r - 1, -1);
+        }
+
+        int64_t rows = (y + r < h ? y + r + 1 : h) - (y > r ? y - r : 0);
+        Pixel* pixels = &dst[y][0];
+
+        /* window histogram before the first column */
+        std::fill(coarse, coarse + 16, 0);
+        std::fill(fineColumn, fineColumn + 16, -1);
+        for(int64_t x = first; x < (int64_t)begin + r && x < w; x++)
+        {
+            add(coarse, &columnCoarse[(x - first) * 16], 16);
+        }
+
+        for(int64_t x = begin; x < end; x++)
+        {
+            /* slide window histogram right */
+            if(x + r < w)
+            {
+                add(coarse, &columnCoarse[(x + r - first) * 16], 16);
+            }
+            if(x > r && x > (int64_t)begin)
+            {
+                sub(coarse, &columnCoarse[(x - r - 1 - first) * 16], 16);
+            }
+
+            int64_t columns = (x + r < w ? x + r + 1 : w) - (x > r ? x - r : 0);
+            uint64_t count = rows * columns;
+            uint64_t rank = count * percentile / 100;
+            rank = rank < count ? rank : count - 1;
+
+            /* coarse bin which holds the rank */
+            uint64_t sum = 0;
+            int c = 0;
+            while(sum + coarse[c] <= rank)
+            {
+                sum += coarse[c];
+                c++;
+            }
+
+            /* bring fine bins of it up to date */
+            uint32_t* bins = fine[c];
+            if(fineColumn[c] < 0 || x - fineColumn[c] > 2 * r + 1)
+            {
+                std::fill(bins, bins + 16, 0);
+                for(int64_t i = (x > r ? x - r : 0); i < x + r + 1 && i < w; i++)
+                {
+                    add(bins, &columnFine[(i - first) * 256 + c * 16], 16);
+                }
+            }
+            else
+            {
+                for(int64_t i = fineColumn[c] + 1; i <= x; i++)
+                {
+                    if(i + r < w)
+                    {
+                        add(bins, &columnFine[(i + r - first) * 256 + c * 16], 16);
+                    }
+                    if(i > r)
+                    {
+                        sub(bins, &columnFine[(i - r - 1 - first) * 256 + c * 16], 16);
+                    }
+                }
+            }
+            fineColumn[c] = x;
+
+            int f = 0;
+            while(sum + bins[f] <= rank)
+            {
+                sum += bins[f];
+                f++;
+            }
+
+            Channels<Pixel>::set(pixels[x], channel, c * 16 + f);
         }
     }
+}
+
+
+/* 
+ * van Herk / Gil-Werman : the padded line is cut into blocks of the window size ,
+ * a window always covers the suffix of one block and the prefix of the next one ,
+ * so each result costs 3 comparisons no matter how big the window is.
+ * Lines out of the image are filled by identity , which truncates the window at the border.
+ */
+template<typename Pixel, typename Operator>
+static void morphology(const Mat<Pixel>& src, Mat<Pixel>& dst, uint32_t radiusX, uint32_t radiusY, int16_t identity, Operator op)
+{
+    int64_t w = src.width();
+    int64_t h = src.height();
+
+    /* channel c of src is not read after writing channel c of dst , so they can be the same */
+    if(&src == &dst)
+    {
+        dst.detach();
+    }
+    else
+    {
+        prepare(dst, w, h);
+    }
+
+    int64_t size = 2 * (int64_t)radiusX + 1;
+    int64_t length = (w + 2 * radiusX + size - 1) / size * size;
+
+    int64_t sizeY = 2 * (int64_t)radiusY + 1;
+    int64_t lengthY = (h + 2 * radiusY + sizeY - 1) / sizeY * sizeY;
+    Mat<int16_t> plane(w, h);
+    Mat<int16_t> suffixY(w, lengthY);
+
+    for(int channel = 0; channel < Channels<Pixel>::count; channel++)
+    {
+        /* horizontal pass , src -> plane , by bands of rows */
+        parallelFor(0, h, 16, [&](uint32_t first, uint32_t last)
+        {
+            std::vector<int16_t> line(length);
+            std::vector<int16_t> prefix(length);
+            std::vector<int16_t> suffix(length);
+            for(int64_t y = first; y < last; y++)
+            {
+                std::fill(line.begin(), line.end(), identity);
+                const Pixel* pixels = &src[y][0];
+                for(int64_t x = 0; x < w; x++)
+                {
+                    line[radiusX + x] = Channels<Pixel>::get(pixels[x], channel);
+                }
+
+                for(int64_t i = 0; i < length; i++)
+                {
+                    prefix[i] = i % size == 0 ? line[i] : op(prefix[i - 1], line[i]);
+                }
+                for(int64_t i = length - 1; i >= 0; i--)
+                {
+                    suffix[i] = i % size == size - 1 ? line[i] : op(suffix[i + 1], line[i]);
+                }
+
+                int16_t* values = &plane[y][0];
+                for(int64_t x = 0; x < w; x++)
+                {
+                    values[x] = op(suffix[x], prefix[x + size - 1]);
+                }
+
+                if(channel == 0 && &src != &dst)
+                {
+                    Pixel* others = &dst[y][0];
+                    for(int64_t x = 0; x < w; x++)
+                    {
+                        Channels<Pixel>::rest(others[x], pixels[x]);
+                    }
+                }
+            }
+        });
+
+        /* vertical pass on whole rows , plane -> dst , by strips of columns */
+        parallelFor(0, w, 64, [&](uint32_t left, uint32_t right)
+        {
+            for(int64_t i = lengthY - 1; i >= 0; i--)
+            {
+                int64_t y = i - radiusY;
+                const int16_t* values = y >= 0 && y < h ? &plane[y][0] : nullptr;
+                bool last = i % sizeY == sizeY - 1;
+                int16_t* suffix = &suffixY[i][0];
+                const int16_t* next = last ? nullptr : &suffixY[i + 1][0];
+                for(int64_t x = left; x < right; x++)
+                {
+                    int16_t value = values != nullptr ? values[x] : identity;
+                    suffix[x] = last ? value : op(next[x], value);
+                }
+            }
+
+            std::vector<int16_t> prefixY(right - left);
+            for(int64_t i = 0; i < h + 2 * (int64_t)radiusY; i++)
+            {
+                int64_t y = i - radiusY;
+                const int16_t* values = y >= 0 && y < h ? &plane[y][0] : nullptr;
+                bool first = i % sizeY == 0;
+                for(int64_t x = left; x < right; x++)
+                {
+                    int16_t value = values != nullptr ? values[x] : identity;
+                    prefixY[x - left] = first ? value : op(prefixY[x - left], value);
+                }
+
+                /* window of row (i - 2 * radiusY) ends here */
+                if(i >= 2 * (int64_t)radiusY)
+                {
+                    int64_t row = i - 2 * radiusY;
+                    const int16_t* suffix = &suffixY[row][0];
+                    Pixel* pixels = &dst[row][0];
+                    for(int64_t x = left; x < right; x++)
+                    {
+                        Channels<Pixel>::set(pixels[x], channel, op(suffix[x], prefixY[x - left]));
+                    }
+                }
+            }
+        });
+    }
+}
+
+
+static void edgeKernel(Mat<double>& kernel)
+{
+    kernel.resize(3,3);
+    kernel.map([](double& element){element = 1;});
+    kernel[1][1] = -8;
+}
+
+
+/* 2-D Gaussian distribution is the product of two 1-D distributions */
+static void gaussianVectors(Mat<double>& rowKernel, Mat<double>& colKernel, uint32_t radius, double variance)
+{
+    rowKernel.resize(2*radius + 1, 1);
+    colKernel.resize(1, 2*radius + 1);
+    for(int64_t i = -(int64_t)radius; i <= radius; i++)
+    {
+        rowKernel[0][radius + i] = exp( - ((double)(i)*i) / (2*variance*variance));
+    }
 
-    return callback(temp);
+    double sum = rowKernel.reduce<double>([](double& element){return element;});
+    for(uint32_t i = 0; i < 2*radius + 1; i++)
+    {
+        rowKernel[0][i] /= sum;
+        colKernel[i][0] = rowKernel[0][i];
+    }
 }
 
+
 static double bicubicCoefficient(double offset)
 {
     double a = -0.5;
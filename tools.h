@@ -11,20 +11,150 @@ void grayScale(Image& mat);
 void binaryzation(Image& mat, uint8_t threshold = 0);
 
 bool convolution(Image& mat, Mat<double>& kernel);
+bool sepConvolution(Image& mat, Mat<double>& rowKernel, Mat<double>& colKernel);
 
 void detectEdge(Image& mat);
 
 void averageBlur(Image& mat, uint32_t radius);
+void rankFilter(Image& mat, uint32_t radius, double percentile);
 void medianBlur(Image& mat, uint32_t radius);
 
 void erode(Image& mat, uint32_t radius);
+void erode(Image& mat, uint32_t radiusX, uint32_t radiusY);
 void dilate(Image& mat, uint32_t radius);
+void dilate(Image& mat, uint32_t radiusX, uint32_t radiusY);
+void morphOpen(Image& mat, uint32_t radius);
+void morphClose(Image& mat, uint32_t radius);
+void morphGradient(Image& mat, uint32_t radius);
 
 void gaussian(Mat<double>& mat, uint32_t radius, double variance);
 void gaussianBlur(Image& mat, uint32_t radius, double variance = 1);
 
 void resize(Image& mat, uint32_t width, uint32_t height);
 void bicubic(Image& mat, uint32_t width, uint32_t height);
+
+/* write the result into dst , its buffer is reused if the size matches , src and dst can be the same image */
+void grayScale(const Image& src, Image& dst);
+void binaryzation(const Image& src, Image& dst, uint8_t threshold = 0);
+
+bool convolution(const Image& src, Image& dst, Mat<double>& kernel);
+bool sepConvolution(const Image& src, Image& dst, Mat<double>& rowKernel, Mat<double>& colKernel);
+
+void detectEdge(const Image& src, Image& dst);
+
+void averageBlur(const Image& src, Image& dst, uint32_t radius);
+void rankFilter(const Image& src, Image& dst, uint32_t radius, double percentile);
+void medianBlur(const Image& src, Image& dst, uint32_t radius);
+
+void erode(const Image& src, Image& dst, uint32_t radius);
+void erode(const Image& src, Image& dst, uint32_t radiusX, uint32_t radiusY);
+void dilate(const Image& src, Image& dst, uint32_t radius);
+void dilate(const Image& src, Image& dst, uint32_t radiusX, uint32_t radiusY);
+void morphOpen(const Image& src, Image& dst, uint32_t radius);
+void morphClose(const Image& src, Image& dst, uint32_t radius);
+void morphGradient(const Image& src, Image& dst, uint32_t radius);
+
+void gaussianBlur(const Image& src, Image& dst, uint32_t radius, double variance = 1);
+
+void resize(const Image& src, Image& dst, uint32_t width, uint32_t height);
+void bicubic(const Image& src, Image& dst, uint32_t width, uint32_t height);
+
+/* compact gray-scale image */
+void grayScale(const Image& src, GrayImage& dst);
+void binaryzation(GrayImage& mat, uint8_t threshold = 0);
+
+bool convolution(GrayImage& mat, Mat<double>& kernel);
+bool sepConvolution(GrayImage& mat, Mat<double>& rowKernel, Mat<double>& colKernel);
+
+void detectEdge(GrayImage& mat);
+
+void averageBlur(GrayImage& mat, uint32_t radius);
+void rankFilter(GrayImage& mat, uint32_t radius, double percentile);
+void medianBlur(GrayImage& mat, uint32_t radius);
+
+void erode(GrayImage& mat, uint32_t radius);
+void erode(GrayImage& mat, uint32_t radiusX, uint32_t radiusY);
+void dilate(GrayImage& mat, uint32_t radius);
+void dilate(GrayImage& mat, uint32_t radiusX, uint32_t radiusY);
+void morphOpen(GrayImage& mat, uint32_t radius);
+void morphClose(GrayImage& mat, uint32_t radius);
+void morphGradient(GrayImage& mat, uint32_t radius);
+
+void gaussianBlur(GrayImage& mat, uint32_t radius, double variance = 1);
+
+void binaryzation(const GrayImage& src, GrayImage& dst, uint8_t threshold = 0);
+
+bool convolution(const GrayImage& src, GrayImage& dst, Mat<double>& kernel);
+bool sepConvolution(const GrayImage& src, GrayImage& dst, Mat<double>& rowKernel, Mat<double>& colKernel);
+
+void detectEdge(const GrayImage& src, GrayImage& dst);
+
+void averageBlur(const GrayImage& src, GrayImage& dst, uint32_t radius);
+void rankFilter(const GrayImage& src, GrayImage& dst, uint32_t radius, double percentile);
+void medianBlur(const GrayImage& src, GrayImage& dst, uint32_t radius);
+
+void erode(const GrayImage& src, GrayImage& dst, uint32_t radius);
+void erode(const GrayImage& src, GrayImage& dst, uint32_t radiusX, uint32_t radiusY);
+void dilate(const GrayImage& src, GrayImage& dst, uint32_t radius);
+void dilate(const GrayImage& src, GrayImage& dst, uint32_t radiusX, uint32_t radiusY);
+void morphOpen(const GrayImage& src, GrayImage& dst, uint32_t radius);
+void morphClose(const GrayImage& src, GrayImage& dst, uint32_t radius);
+void morphGradient(const GrayImage& src, GrayImage& dst, uint32_t radius);
+
+void gaussianBlur(const GrayImage& src, GrayImage& dst, uint32_t radius, double variance = 1);
+
+void resize(GrayImage& mat, uint32_t width, uint32_t height);
+void resize(const GrayImage& src, GrayImage& dst, uint32_t width, uint32_t height);
+
+/* compact color images , 3 bytes per pixel */
+void grayScale(const Rgb24Image& src, GrayImage& dst);
+
+bool convolution(Rgb24Image& mat, Mat<double>& kernel);
+bool sepConvolution(Rgb24Image& mat, Mat<double>& rowKernel, Mat<double>& colKernel);
+
+void averageBlur(Rgb24Image& mat, uint32_t radius);
+void rankFilter(Rgb24Image& mat, uint32_t radius, double percentile);
+void medianBlur(Rgb24Image& mat, uint32_t radius);
+
+void gaussianBlur(Rgb24Image& mat, uint32_t radius, double variance = 1);
+
+void resize(Rgb24Image& mat, uint32_t width, uint32_t height);
+
+bool convolution(const Rgb24Image& src, Rgb24Image& dst, Mat<double>& kernel);
+bool sepConvolution(const Rgb24Image& src, Rgb24Image& dst, Mat<double>& rowKernel, Mat<double>& colKernel);
+
+void averageBlur(const Rgb24Image& src, Rgb24Image& dst, uint32_t radius);
+void rankFilter(const Rgb24Image& src, Rgb24Image& dst, uint32_t radius, double percentile);
+void medianBlur(const Rgb24Image& src, Rgb24Image& dst, uint32_t radius);
+
+void gaussianBlur(const Rgb24Image& src, Rgb24Image& dst, uint32_t radius, double variance = 1);
+
+void resize(const Rgb24Image& src, Rgb24Image& dst, uint32_t width, uint32_t height);
+
+/* 4 bytes per pixel , alpha is kept */
+void grayScale(const Rgba32Image& src, GrayImage& dst);
+
+bool convolution(Rgba32Image& mat, Mat<double>& kernel);
+bool sepConvolution(Rgba32Image& mat, Mat<double>& rowKernel, Mat<double>& colKernel);
+
+void averageBlur(Rgba32Image& mat, uint32_t radius);
+void rankFilter(Rgba32Image& mat, uint32_t radius, double percentile);
+void medianBlur(Rgba32Image& mat, uint32_t radius);
+
+void gaussianBlur(Rgba32Image& mat, uint32_t radius, double variance = 1);
+
+void resize(Rgba32Image& mat, uint32_t width, uint32_t height);
+
+bool convolution(const Rgba32Image& src, Rgba32Image& dst, Mat<double>& kernel);
+bool sepConvolution(const Rgba32Image& src, Rgba32Image& dst, Mat<double>& rowKernel, Mat<double>& colKernel);
+
+void averageBlur(const Rgba32Image& src, Rgba32Image& dst, uint32_t radius);
+void rankFilter(const Rgba32Image& src, Rgba32Image& dst, uint32_t radius, double percentile);
+void medianBlur(const Rgba32Image& src, Rgba32Image& dst, uint32_t radius);
+
+void gaussianBlur(const Rgba32Image& src, Rgba32Image& dst, uint32_t radius, double variance = 1);
+
+void resize(const Rgba32Image& src, Rgba32Image& dst, uint32_t width, uint32_t height);
 }; // namespace lolita
 
 #endif
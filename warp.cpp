@@ -0,0 +1,613 @@
+#include "warp.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace lolita
+{
+
+/**[Private]***********************************************************************************************/
+/* fractions of coordinates are in 1 / 32 pixel , bilinear weights of a fraction add up to 1 << weightBits */
+static const int32_t fractionBits = 5;
+static const int32_t fractionSteps = 1 << fractionBits;
+static const int32_t weightBits = 14;
+
+/* warps check blocks of dst against the source , and restart stepping at every block */
+static const uint32_t blockWidth = 64;
+static const uint32_t blockHeight = 16;
+
+/* weights of the top-left , top-right , bottom-left and bottom-right pixels */
+struct Weights
+{
+    int16_t w[4];
+};
+
+static const Weights* weightTable();
+static void convertRow(const float* mapX, const float* mapY, MapPoint* points, uint16_t* fractions, uint32_t width);
+template<typename Pixel>
+static void gatherRow(const Mat<Pixel>& src, Pixel* dst, const MapPoint* points, const uint16_t* fractions,
+                        uint32_t width, Interpolation interp);
+template<typename Pixel>
+static bool remapFloat(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<float>& mapX, const Mat<float>& mapY,
+                        Interpolation interp);
+template<typename Pixel>
+static bool remapFixed(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<MapPoint>& points, const Mat<uint16_t>& fractions,
+                        Interpolation interp);
+template<typename Pixel>
+static bool warp(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<double>& matrix, uint32_t width, uint32_t height,
+                    Interpolation interp, bool perspective);
+static bool invert(const Mat<double>& matrix, bool perspective, double* inverse);
+static bool outside(const double* m, uint32_t left, uint32_t top, uint32_t right, uint32_t bottom, uint32_t width, uint32_t height);
+static bool affineRow(const double* m, uint32_t x, uint32_t y, uint32_t width, MapPoint* points, uint16_t* fractions);
+static void perspectiveRow(const double* m, uint32_t x, uint32_t y, uint32_t width, float* mapX, float* mapY);
+template<typename Pixel>
+static void prepare(Mat<Pixel>& dst, uint32_t width, uint32_t height);
+template<typename Pixel>
+static bool overlap(const Mat<Pixel>& a, const Mat<Pixel>& b);
+static RgbPixel blend(const RgbPixel& a, const RgbPixel& b, const RgbPixel& c, const RgbPixel& d, const Weights& k);
+static uint8_t blend(uint8_t a, uint8_t b, uint8_t c, uint8_t d, const Weights& k);
+
+
+/**********************************************************************************************************/
+bool remap(const Image& src, Image& dst, const Mat<float>& mapX, const Mat<float>& mapY, Interpolation interp)
+{
+    return remapFloat(src, dst, mapX, mapY, interp);
+}
+
+bool remap(const GrayImage& src, GrayImage& dst, const Mat<float>& mapX, const Mat<float>& mapY, Interpolation interp)
+{
+    return remapFloat(src, dst, mapX, mapY, interp);
+}
+
+bool convertMaps(const Mat<float>& mapX, const Mat<float>& mapY, Mat<MapPoint>& points, Mat<uint16_t>& fractions)
+{
+    uint32_t w = mapX.width();
+    uint32_t h = mapX.height();
+    if(mapY.width() != w || mapY.height() != h)
+    {
+        return false;
+    }
+
+    prepare(points, w, h);
+    prepare(fractions, w, h);
+    if(w == 0 || h == 0)
+    {
+        return true;
+    }
+
+    parallelFor(0, h, 8, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t y = first; y < last; y++)
+        {
+            convertRow(&mapX[y][0], &mapY[y][0], &points[y][0], &fractions[y][0], w);
+        }
+    });
+    return true;
+}
+
+bool remap(const Image& src, Image& dst, const Mat<MapPoint>& points, const Mat<uint16_t>& fractions, Interpolation interp)
+{
+    return remapFixed(src, dst, points, fractions, interp);
+}
+
+bool remap(const GrayImage& src, GrayImage& dst, const Mat<MapPoint>& points, const Mat<uint16_t>& fractions, Interpolation interp)
+{
+    return remapFixed(src, dst, points, fractions, interp);
+}
+
+bool warpAffine(const Image& src, Image& dst, const Mat<double>& matrix, uint32_t width, uint32_t height, Interpolation interp)
+{
+    return warp(src, dst, matrix, width, height, interp, false);
+}
+
+bool warpAffine(const GrayImage& src, GrayImage& dst, const Mat<double>& matrix, uint32_t width, uint32_t height, Interpolation interp)
+{
+    return warp(src, dst, matrix, width, height, interp, false);
+}
+
+bool warpPerspective(const Image& src, Image& dst, const Mat<double>& matrix, uint32_t width, uint32_t height, Interpolation interp)
+{
+    return warp(src, dst, matrix, width, height, interp, true);
+}
+
+bool warpPerspective(const GrayImage& src, GrayImage& dst, const Mat<double>& matrix, uint32_t width, uint32_t height, Interpolation interp)
+{
+    return warp(src, dst, matrix, width, height, interp, true);
+}
+
+Mat<double> rotationMatrix(double x, double y, double angle, double scale)
+{
+    /* y points down , so counterclockwise on the screen is a negative angle in math */
+    double a = scale * std::cos(angle);
+    double b = scale * std::sin(angle);
+    Mat<double> matrix(3, 2);
+    matrix[0][0] = a;
+    matrix[0][1] = b;
+    matrix[0][2] = (1 - a) * x - b * y;
+    matrix[1][0] = -b;
+    matrix[1][1] = a;
+    matrix[1][2] = b * x + (1 - a) * y;
+    return matrix;
+}
+
+
+/**[Private]***********************************************************************************************/
+/* built once , 32 x 32 fractions , the index is fy * 32 + fx */
+static const Weights* weightTable()
+{
+    static const std::vector<Weights> table = []()
+    {
+        std::vector<Weights> weights(fractionSteps * fractionSteps);
+        const int32_t scale = 1 << (weightBits - 2 * fractionBits);
+        for(int32_t fy = 0; fy < fractionSteps; fy++)
+        {
+            for(int32_t fx = 0; fx < fractionSteps; fx++)
+            {
+                Weights& k = weights[fy * fractionSteps + fx];
+                k.w[0] = static_cast<int16_t>((fractionSteps - fx) * (fractionSteps - fy) * scale);
+                k.w[1] = static_cast<int16_t>(fx * (fractionSteps - fy) * scale);
+                k.w[2] = static_cast<int16_t>((fractionSteps - fx) * fy * scale);
+                k.w[3] = static_cast<int16_t>(fx * fy * scale);
+            }
+        }
+        return weights;
+    }();
+    return table.data();
+}
+
+/* round coordinates to 1 / 32 pixel , a point out of the range of int16_t goes to (-32768, -32768) */
+static void convertRow(const float* mapX, const float* mapY, MapPoint* points, uint16_t* fractions, uint32_t width)
+{
+    /* the bias makes coordinates positive , so truncation rounds them , it's much faster than std::lrint */
+    const int32_t limit = 32768 * fractionSteps;
+    const double bias = limit + 0.5;
+    for(uint32_t x = 0; x < width; x++)
+    {
+        double fx = mapX[x] * static_cast<double>(fractionSteps);
+        double fy = mapY[x] * static_cast<double>(fractionSteps);
+        if(!(fx >= -limit && fx < limit - 1) || !(fy >= -limit && fy < limit - 1))
+        {
+            points[x].x = INT16_MIN;
+            points[x].y = INT16_MIN;
+            fractions[x] = 0;
+            continue;
+        }
+
+        int32_t ix = static_cast<int32_t>(fx + bias);
+        int32_t iy = static_cast<int32_t>(fy + bias);
+        int32_t rx = ix & (fractionSteps - 1);
+        int32_t ry = iy & (fractionSteps - 1);
+        points[x].x = static_cast<int16_t>((ix >> fractionBits) - 32768);
+        points[x].y = static_cast<int16_t>((iy >> fractionBits) - 32768);
+        fractions[x] = static_cast<uint16_t>(ry * fractionSteps + rx);
+    }
+}
+
+/*
+ * points inside the source take 4 pixels without checking bounds ,
+ * points on the border take pixels inside only , the others are 0
+ */
+template<typename Pixel>
+static void gatherRow(const Mat<Pixel>& src, Pixel* dst, const MapPoint* points, const uint16_t* fractions,
+                        uint32_t width, Interpolation interp)
+{
+    const Pixel blank = Pixel();
+    int32_t w = static_cast<int32_t>(src.width());
+    int32_t h = static_cast<int32_t>(src.height());
+    if(w == 0 || h == 0)
+    {
+        for(uint32_t i = 0; i < width; i++)
+        {
+            dst[i] = blank;
+        }
+        return;
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(&src[0][0]);
+    ptrdiff_t step = src.step();
+    if(interp == Interpolation::Nearest)
+    {
+        for(uint32_t i = 0; i < width; i++)
+        {
+            int32_t x = points[i].x + ((fractions[i] & (fractionSteps - 1)) >> (fractionBits - 1));
+            int32_t y = points[i].y + (fractions[i] >> (2 * fractionBits - 1));
+            if(static_cast<uint32_t>(x) < static_cast<uint32_t>(w) && static_cast<uint32_t>(y) < static_cast<uint32_t>(h))
+            {
+                dst[i] = reinterpret_cast<const Pixel*>(data + y * step)[x];
+            }
+            else
+            {
+                dst[i] = blank;
+            }
+        }
+        return;
+    }
+
+    const Weights* table = weightTable();
+    for(uint32_t i = 0; i < width; i++)
+    {
+        int32_t x = points[i].x;
+        int32_t y = points[i].y;
+        const Weights& k = table[fractions[i]];
+        if(static_cast<uint32_t>(x) < static_cast<uint32_t>(w - 1) && static_cast<uint32_t>(y) < static_cast<uint32_t>(h - 1))
+        {
+            const Pixel* top = reinterpret_cast<const Pixel*>(data + y * step) + x;
+            const Pixel* bottom = reinterpret_cast<const Pixel*>(data + (y + 1) * step) + x;
+            dst[i] = blend(top[0], top[1], bottom[0], bottom[1], k);
+        }
+        else if(x >= -1 && x < w && y >= -1 && y < h)
+        {
+            bool left = x >= 0;
+            bool right = x + 1 < w;
+            bool up = y >= 0;
+            bool down = y + 1 < h;
+            const Pixel* top = up ? reinterpret_cast<const Pixel*>(data + y * step) : nullptr;
+            const Pixel* bottom = down ? reinterpret_cast<const Pixel*>(data + (y + 1) * step) : nullptr;
+            dst[i] = blend(up && left ? top[x] : blank, up && right ? top[x + 1] : blank,
+                            down && left ? bottom[x] : blank, down && right ? bottom[x + 1] : blank, k);
+        }
+        else
+        {
+            dst[i] = blank;
+        }
+    }
+}
+
+/* maps are converted row by row into a buffer , so both kinds of maps share the gathering */
+template<typename Pixel>
+static bool remapFloat(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<float>& mapX, const Mat<float>& mapY,
+                        Interpolation interp)
+{
+    uint32_t w = mapX.width();
+    uint32_t h = mapX.height();
+    if(mapY.width() != w || mapY.height() != h)
+    {
+        return false;
+    }
+
+    /* source pixels are read after writing them */
+    if(&src == &dst)
+    {
+        const Mat<Pixel> temp = dst;
+        return remapFloat(temp, dst, mapX, mapY, interp);
+    }
+
+    prepare(dst, w, h);
+    if(w == 0 || h == 0)
+    {
+        return true;
+    }
+
+    /* dst may be a view of src or the reverse , then gather from a copy */
+    if(overlap(src, dst))
+    {
+        Mat<Pixel> temp = src;
+        temp.detach();
+        return remapFloat(temp, dst, mapX, mapY, interp);
+    }
+
+    parallelFor(0, h, 8, [&](uint32_t first, uint32_t last)
+    {
+        std::vector<MapPoint> points(w);
+        std::vector<uint16_t> fractions(w);
+        for(uint32_t y = first; y < last; y++)
+        {
+            convertRow(&mapX[y][0], &mapY[y][0], points.data(), fractions.data(), w);
+            gatherRow(src, &dst[y][0], points.data(), fractions.data(), w, interp);
+        }
+    });
+    return true;
+}
+
+template<typename Pixel>
+static bool remapFixed(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<MapPoint>& points, const Mat<uint16_t>& fractions,
+                        Interpolation interp)
+{
+    uint32_t w = points.width();
+    uint32_t h = points.height();
+    if(fractions.width() != w || fractions.height() != h)
+    {
+        return false;
+    }
+
+    if(&src == &dst)
+    {
+        const Mat<Pixel> temp = dst;
+        return remapFixed(temp, dst, points, fractions, interp);
+    }
+
+    prepare(dst, w, h);
+    if(w == 0 || h == 0)
+    {
+        return true;
+    }
+
+    if(overlap(src, dst))
+    {
+        Mat<Pixel> temp = src;
+        temp.detach();
+        return remapFixed(temp, dst, points, fractions, interp);
+    }
+
+    parallelFor(0, h, 8, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t y = first; y < last; y++)
+        {
+            gatherRow(src, &dst[y][0], &points[y][0], &fractions[y][0], w, interp);
+        }
+    });
+    return true;
+}
+
+/*
+ * every band of blockHeight rows is split into blocks , a block mapped outside src is cleared ,
+ * other blocks step source coordinates along their rows and gather them as remap does
+ */
+template<typename Pixel>
+static bool warp(const Mat<Pixel>& src, Mat<Pixel>& dst, const Mat<double>& matrix, uint32_t width, uint32_t height,
+                    Interpolation interp, bool perspective)
+{
+    double m[9];
+    if(!invert(matrix, perspective, m))
+    {
+        return false;
+    }
+
+    /* source pixels are read after writing them */
+    if(&src == &dst)
+    {
+        const Mat<Pixel> temp = dst;
+        return warp(temp, dst, matrix, width, height, interp, perspective);
+    }
+
+    prepare(dst, width, height);
+    if(width == 0 || height == 0)
+    {
+        return true;
+    }
+
+    /* dst may be a view of src or the reverse , then gather from a copy */
+    if(overlap(src, dst))
+    {
+        Mat<Pixel> temp = src;
+        temp.detach();
+        return warp(temp, dst, matrix, width, height, interp, perspective);
+    }
+
+    const Pixel blank = Pixel();
+    uint32_t bands = (height + blockHeight - 1) / blockHeight;
+    parallelFor(0, bands, 1, [&](uint32_t first, uint32_t last)
+    {
+        MapPoint points[blockWidth];
+        uint16_t fractions[blockWidth];
+        float mapX[blockWidth];
+        float mapY[blockWidth];
+        for(uint32_t band = first; band < last; band++)
+        {
+            uint32_t top = band * blockHeight;
+            uint32_t bottom = std::min(top + blockHeight, height);
+            for(uint32_t left = 0; left < width; left += blockWidth)
+            {
+                uint32_t right = std::min(left + blockWidth, width);
+                uint32_t n = right - left;
+                bool clear = outside(m, left, top, right, bottom, src.width(), src.height());
+                for(uint32_t y = top; y < bottom; y++)
+                {
+                    Pixel* row = &dst[y][left];
+                    if(clear)
+                    {
+                        std::fill(row, row + n, blank);
+                    }
+                    else if(perspective)
+                    {
+                        perspectiveRow(m, left, y, n, mapX, mapY);
+                        convertRow(mapX, mapY, points, fractions, n);
+                        gatherRow(src, row, points, fractions, n, interp);
+                    }
+                    else if(affineRow(m, left, y, n, points, fractions))
+                    {
+                        gatherRow(src, row, points, fractions, n, interp);
+                    }
+                    else
+                    {
+                        /* coordinates too far for fixed-point stepping , they are outside anyway */
+                        perspectiveRow(m, left, y, n, mapX, mapY);
+                        convertRow(mapX, mapY, points, fractions, n);
+                        gatherRow(src, row, points, fractions, n, interp);
+                    }
+                }
+            }
+        }
+    });
+    return true;
+}
+
+/* inverse maps dst to src , it's 3 x 3 in row-major order , the last row of an affine inverse is (0, 0, 1) */
+static bool invert(const Mat<double>& matrix, bool perspective, double* inverse)
+{
+    if(matrix.width() != 3 || matrix.height() != (perspective ? 3u : 2u))
+    {
+        return false;
+    }
+
+    double a[9] = {matrix[0][0], matrix[0][1], matrix[0][2], matrix[1][0], matrix[1][1], matrix[1][2], 0, 0, 1};
+    if(perspective)
+    {
+        a[6] = matrix[2][0];
+        a[7] = matrix[2][1];
+        a[8] = matrix[2][2];
+    }
+
+    /* adjugate divided by determinant */
+    double cofactors[9] = {
+        a[4] * a[8] - a[5] * a[7], a[2] * a[7] - a[1] * a[8], a[1] * a[5] - a[2] * a[4],
+        a[5] * a[6] - a[3] * a[8], a[0] * a[8] - a[2] * a[6], a[2] * a[3] - a[0] * a[5],
+        a[3] * a[7] - a[4] * a[6], a[1] * a[6] - a[0] * a[7], a[0] * a[4] - a[1] * a[3],
+    };
+    double determinant = a[0] * cofactors[0] + a[1] * cofactors[3] + a[2] * cofactors[6];
+    if(determinant == 0 || !std::isfinite(determinant))
+    {
+        return false;
+    }
+
+    for(int i = 0; i < 9; i++)
+    {
+        inverse[i] = cofactors[i] / determinant;
+    }
+    return true;
+}
+
+/*
+ * true if the block [left, right) x [top, bottom) of dst is mapped outside the source with a margin ,
+ * a block is mapped into the convex hull of its corners unless it crosses the horizon of a perspective
+ */
+static bool outside(const double* m, uint32_t left, uint32_t top, uint32_t right, uint32_t bottom, uint32_t width, uint32_t height)
+{
+    const double margin = 2;
+    double corners[4][2] = {{left * 1.0, top * 1.0}, {right - 1.0, top * 1.0}, {left * 1.0, bottom - 1.0}, {right - 1.0, bottom - 1.0}};
+    double minX = HUGE_VAL, maxX = -HUGE_VAL, minY = HUGE_VAL, maxY = -HUGE_VAL;
+    double sign = m[6] * left + m[7] * top + m[8];
+    for(int i = 0; i < 4; i++)
+    {
+        double x = corners[i][0];
+        double y = corners[i][1];
+        double w = m[6] * x + m[7] * y + m[8];
+        if(!(w * sign > 0))
+        {
+            return false;
+        }
+
+        double sx = (m[0] * x + m[1] * y + m[2]) / w;
+        double sy = (m[3] * x + m[4] * y + m[5]) / w;
+        minX = std::min(minX, sx);
+        maxX = std::max(maxX, sx);
+        minY = std::min(minY, sy);
+        maxY = std::max(maxY, sy);
+    }
+
+    return maxX < -1 - margin || minX > width + margin || maxY < -1 - margin || minY > height + margin;
+}
+
+/*
+ * coordinates are 32.32 fixed-point biased by 32768 , a step is an addition ,
+ * the bias makes a coordinate in the range of int16_t exactly an upper half less than 65536 ;
+ * return false if the row is too far for 64 bits
+ */
+static bool affineRow(const double* m, uint32_t x, uint32_t y, uint32_t width, MapPoint* points, uint16_t* fractions)
+{
+    const double one = 4294967296.0;
+    const double limit = 1073741824.0;
+    double sx = m[0] * x + m[1] * y + m[2] + 32768;
+    double sy = m[3] * x + m[4] * y + m[5] + 32768;
+    double ex = sx + m[0] * width;
+    double ey = sy + m[3] * width;
+    if(!(std::abs(sx) < limit && std::abs(sy) < limit && std::abs(ex) < limit && std::abs(ey) < limit))
+    {
+        return false;
+    }
+
+    /* half of a fraction rounds coordinates to the nearest 1 / 32 pixel */
+    const int32_t shift = 32 - fractionBits;
+    int64_t px = static_cast<int64_t>(std::floor(sx * one)) + (int64_t(1) << (shift - 1));
+    int64_t py = static_cast<int64_t>(std::floor(sy * one)) + (int64_t(1) << (shift - 1));
+    int64_t dx = static_cast<int64_t>(std::floor(m[0] * one + 0.5));
+    int64_t dy = static_cast<int64_t>(std::floor(m[3] * one + 0.5));
+    for(uint32_t i = 0; i < width; i++)
+    {
+        uint64_t ux = static_cast<uint64_t>(px);
+        uint64_t uy = static_cast<uint64_t>(py);
+        if((ux >> 32) < 65536 && (uy >> 32) < 65536)
+        {
+            points[i].x = static_cast<int16_t>(static_cast<int32_t>(ux >> 32) - 32768);
+            points[i].y = static_cast<int16_t>(static_cast<int32_t>(uy >> 32) - 32768);
+            fractions[i] = static_cast<uint16_t>(((uy >> shift) & (fractionSteps - 1)) * fractionSteps + ((ux >> shift) & (fractionSteps - 1)));
+        }
+        else
+        {
+            points[i].x = INT16_MIN;
+            points[i].y = INT16_MIN;
+            fractions[i] = 0;
+        }
+        px += dx;
+        py += dy;
+    }
+    return true;
+}
+
+/* numerators and the denominator step along the row , points on the horizon are NaN */
+static void perspectiveRow(const double* m, uint32_t x, uint32_t y, uint32_t width, float* mapX, float* mapY)
+{
+    double sx = m[0] * x + m[1] * y + m[2];
+    double sy = m[3] * x + m[4] * y + m[5];
+    double sw = m[6] * x + m[7] * y + m[8];
+    for(uint32_t i = 0; i < width; i++)
+    {
+        if(sw != 0)
+        {
+            double k = 1 / sw;
+            mapX[i] = static_cast<float>(sx * k);
+            mapY[i] = static_cast<float>(sy * k);
+        }
+        else
+        {
+            mapX[i] = NAN;
+            mapY[i] = NAN;
+        }
+        sx += m[0];
+        sy += m[3];
+        sw += m[6];
+    }
+}
+
+/* dst gets the size , its buffer is kept if the size matches and it's not shared */
+template<typename Pixel>
+static void prepare(Mat<Pixel>& dst, uint32_t width, uint32_t height)
+{
+    if(dst.width() != width || dst.height() != height || dst.isShared())
+    {
+        dst = Mat<Pixel>(width, height);
+    }
+}
+
+/*
+ * true if elements of a and b overlap , such as a view returned by roi and its source ,
+ * or copies sharing elements ; dst is not shared after prepare , so only views overlap it there
+ */
+template<typename Pixel>
+static bool overlap(const Mat<Pixel>& a, const Mat<Pixel>& b)
+{
+    if(a.width() == 0 || a.height() == 0 || b.width() == 0 || b.height() == 0)
+    {
+        return false;
+    }
+
+    const Pixel* aFirst = &a[0][0];
+    const Pixel* aLast = &a[a.height() - 1][0];
+    const Pixel* bFirst = &b[0][0];
+    const Pixel* bLast = &b[b.height() - 1][0];
+    uintptr_t aBegin = reinterpret_cast<uintptr_t>(std::min(aFirst, aLast));
+    uintptr_t aEnd = reinterpret_cast<uintptr_t>(std::max(aFirst, aLast) + a.width());
+    uintptr_t bBegin = reinterpret_cast<uintptr_t>(std::min(bFirst, bLast));
+    uintptr_t bEnd = reinterpret_cast<uintptr_t>(std::max(bFirst, bLast) + b.width());
+    return aBegin < bEnd && bBegin < aEnd;
+}
+
+static RgbPixel blend(const RgbPixel& a, const RgbPixel& b, const RgbPixel& c, const RgbPixel& d, const Weights& k)
+{
+    const int32_t half = 1 << (weightBits - 1);
+    RgbPixel pixel;
+    pixel.red = static_cast<int16_t>((a.red * k.w[0] + b.red * k.w[1] + c.red * k.w[2] + d.red * k.w[3] + half) >> weightBits);
+    pixel.green = static_cast<int16_t>((a.green * k.w[0] + b.green * k.w[1] + c.green * k.w[2] + d.green * k.w[3] + half) >> weightBits);
+    pixel.blue = static_cast<int16_t>((a.blue * k.w[0] + b.blue * k.w[1] + c.blue * k.w[2] + d.blue * k.w[3] + half) >> weightBits);
+    pixel.alpha = static_cast<int16_t>((a.alpha * k.w[0] + b.alpha * k.w[1] + c.alpha * k.w[2] + d.alpha * k.w[3] + half) >> weightBits);
+    return pixel;
+}
+
+static uint8_t blend(uint8_t a, uint8_t b, uint8_t c, uint8_t d, const Weights& k)
+{
+    const int32_t half = 1 << (weightBits - 1);
+    return static_cast<uint8_t>((a * k.w[0] + b * k.w[1] + c * k.w[2] + d * k.w[3] + half) >> weightBits);
+}
+
+}; // namespace lolita
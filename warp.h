@@ -0,0 +1,79 @@
+/* Geometric transforms , remapping by coordinate maps and warping by matrices */
+#ifndef LOLITA_WARP_H
+#define LOLITA_WARP_H
+
+#include <cstdint>
+#include "mat.hpp"
+
+namespace lolita
+{
+
+enum class Interpolation
+{
+    Nearest,
+    Bilinear,
+};
+
+/* integer part of a source coordinate packed by convertMaps */
+struct MapPoint
+{
+    int16_t x;
+    int16_t y;
+};
+
+/*
+ * dst(x, y) = src(mapX(x, y), mapY(x, y)) , dst gets the size of the maps ,
+ * pixels mapped outside src are 0 , src and dst can be the same image , or overlapping views ;
+ * return false if sizes of mapX and mapY are different.
+ *
+ * A geometry used by every frame , such as lens undistortion , should be converted once :
+ *
+ *     Mat<MapPoint> points;
+ *     Mat<uint16_t> fractions;
+ *     convertMaps(mapX, mapY, points, fractions);
+ *     while(...)
+ *     {
+ *         remap(frame, dst, points, fractions);
+ *     }
+ */
+bool remap(const Image& src, Image& dst, const Mat<float>& mapX, const Mat<float>& mapY,
+            Interpolation interp = Interpolation::Bilinear);
+bool remap(const GrayImage& src, GrayImage& dst, const Mat<float>& mapX, const Mat<float>& mapY,
+            Interpolation interp = Interpolation::Bilinear);
+
+/*
+ * split coordinates into integer parts and fractions in 1 / 32 pixel , fractions index a table of
+ * fixed-point bilinear weights , so remap does only integer gathers ;
+ * coordinates out of [-32768, 32767] , and NaN , are outside every image.
+ */
+bool convertMaps(const Mat<float>& mapX, const Mat<float>& mapY, Mat<MapPoint>& points, Mat<uint16_t>& fractions);
+
+bool remap(const Image& src, Image& dst, const Mat<MapPoint>& points, const Mat<uint16_t>& fractions,
+            Interpolation interp = Interpolation::Bilinear);
+bool remap(const GrayImage& src, GrayImage& dst, const Mat<MapPoint>& points, const Mat<uint16_t>& fractions,
+            Interpolation interp = Interpolation::Bilinear);
+
+/*
+ * matrix maps src to dst , 3 x 2 for affine and 3 x 3 for perspective , dst is width x height ,
+ * pixels mapped outside src are 0 , src and dst can be the same image , or overlapping views ;
+ * return false if the size of matrix is wrong or it's singular.
+ * Source coordinates step along every row , and blocks of dst mapped outside src are only cleared.
+ *
+ *     Image page;
+ *     warpAffine(scan, page, rotationMatrix(scan.width() / 2.0, scan.height() / 2.0, skew), scan.width(), scan.height());
+ */
+bool warpAffine(const Image& src, Image& dst, const Mat<double>& matrix, uint32_t width, uint32_t height,
+                Interpolation interp = Interpolation::Bilinear);
+bool warpAffine(const GrayImage& src, GrayImage& dst, const Mat<double>& matrix, uint32_t width, uint32_t height,
+                Interpolation interp = Interpolation::Bilinear);
+bool warpPerspective(const Image& src, Image& dst, const Mat<double>& matrix, uint32_t width, uint32_t height,
+                        Interpolation interp = Interpolation::Bilinear);
+bool warpPerspective(const GrayImage& src, GrayImage& dst, const Mat<double>& matrix, uint32_t width, uint32_t height,
+                        Interpolation interp = Interpolation::Bilinear);
+
+/* 3 x 2 affine matrix , rotate counterclockwise by angle in radian around (x, y) , then scale */
+Mat<double> rotationMatrix(double x, double y, double angle, double scale = 1);
+
+}; // namespace lolita
+
+#endif